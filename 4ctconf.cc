@@ -1,15 +1,28 @@
 #include <cstdio>
+#include <cstdint>
+#include <algorithm>
 #include <vector>
-#include <list>
-#include <set>
 #include <map>
+#include <unordered_map>
 #include <sstream>
 #include <cmath>
+#include <thread>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+#include <mutex>
+#include <chrono>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
 #include "gurobi_c++.h"
+#include "rings.h"
 using namespace std;
 
 static GRBEnv env;
-static GRBModel *pgm;
 
 struct edge
 {
@@ -93,510 +106,3082 @@ static const configuration blockcntredu =
   }
 };
 
+/* The line graph of the configuration, in the compressed sparse row
+   form: the neighbors of v are adj[start[v]] ... adj[start[v + 1] - 1].  */
+
+struct graph
+{
+  int n;
+  vector<int> start;
+  vector<int> adj;
+};
+
+/* Builds the line graph from the incidences of the vertices of C, in time
+   linear in its size.  The vertices are first renumbered densely.  */
+
+static void
+conf_to_graph (const configuration &c, graph &g)
+{
+  map<int,int> index;
+  vector<vector<int>> incid;
+  vector<vector<int>> nbrs (c.ne);
+  int e, i;
+
+  for (e = 0; e < c.ne; e++)
+    for (i = 0; i < 2; i++)
+      {
+	map<int,int>::iterator it = index.find (c.es[e].vs[i]);
+	if (it == index.end ())
+	  {
+	    it = index.insert (make_pair (c.es[e].vs[i], (int) incid.size ())).first;
+	    incid.push_back (vector<int> ());
+	  }
+	if (i == 0 || c.es[e].vs[1] != c.es[e].vs[0])
+	  incid[it->second].push_back (e);
+      }
+
+  for (size_t v = 0; v < incid.size (); v++)
+    for (size_t j = 0; j < incid[v].size (); j++)
+      for (size_t k = j + 1; k < incid[v].size (); k++)
+	{
+	  nbrs[incid[v][j]].push_back (incid[v][k]);
+	  nbrs[incid[v][k]].push_back (incid[v][j]);
+	}
+
+  g.n = c.ne;
+  g.start.clear ();
+  g.adj.clear ();
+  for (e = 0; e < c.ne; e++)
+    {
+      /* Parallel edges meet at both ends.  */
+      sort (nbrs[e].begin (), nbrs[e].end ());
+      nbrs[e].erase (unique (nbrs[e].begin (), nbrs[e].end ()), nbrs[e].end ());
+      g.start.push_back (g.adj.size ());
+      g.adj.insert (g.adj.end (), nbrs[e].begin (), nbrs[e].end ());
+    }
+  g.start.push_back (g.adj.size ());
+}
+
+/* A symmetry of the ring: position j of the transformed ring is the
+   position (rot + dir * j) mod outer of the original one.  */
+
+struct ring_symmetry
+{
+  int rot, dir;
+
+  int map (int j, int outer) const
+    {
+      return ((rot + dir * j) % outer + outer) % outer;
+    }
+};
+
+/* The largest number of steps spent looking for the canonical labeling of
+   a configuration.  If it does not suffice, the configuration is labeled
+   as it is given.  */
+
+#define CANON_BUDGET 1000000
+
+/* Computes a canonical form of a configuration, invariant under relabeling
+   of the inner vertices and under rotations and reflections of the ring.
+   For each symmetry of the ring, the inner vertices are labeled in the
+   order they are reached from the ring edges, and then breadth-first from
+   the labeled ones; where the neighbors to label next cannot be told apart
+   by their labeled neighbors, all their orders are tried.  The canonical
+   form is the smallest resulting sequence of the ring edge ends followed
+   by the sorted inner edges.  */
+
+struct conf_labeler
+{
+  const configuration &c;
+  map<int,int> index;
+  vector<vector<int>> nbrs;
+  vector<int> label, bylabel;
+  vector<int> best, sym_best;
+  ring_symmetry best_sym, sym;
+  vector<pair<ring_symmetry,vector<int>>> sym_codes;
+  long steps;
+
+  conf_labeler (const configuration &conf) : c (conf)
+    {
+      for (int e = 0; e < c.ne; e++)
+	for (int i = 0; i < 2; i++)
+	  if (c.es[e].vs[i] >= 0 && !index.count (c.es[e].vs[i]))
+	    {
+	      int id = index.size ();
+	      index[c.es[e].vs[i]] = id;
+	    }
+      nbrs.resize (index.size ());
+      for (int e = c.outer; e < c.ne; e++)
+	{
+	  int a = index[c.es[e].vs[0]], b = index[c.es[e].vs[1]];
+	  nbrs[a].push_back (b);
+	  nbrs[b].push_back (a);
+	}
+    }
+
+  int ring_end (int pos)
+    {
+      const edge &e = c.es[pos];
+      return index[e.vs[0] >= 0 ? e.vs[0] : e.vs[1]];
+    }
+
+  void assign (int v)
+    {
+      label[v] = bylabel.size ();
+      bylabel.push_back (v);
+    }
+
+  void unassign (int v)
+    {
+      label[v] = -1;
+      bylabel.pop_back ();
+    }
+
+  vector<int> signature (int v)
+    {
+      vector<int> sig;
+      for (int u : nbrs[v])
+	if (label[u] >= 0)
+	  sig.push_back (label[u]);
+      sort (sig.begin (), sig.end ());
+      return sig;
+    }
+
+  void leaf (void)
+    {
+      vector<int> code;
+      for (int j = 0; j < c.outer; j++)
+	code.push_back (label[ring_end (sym.map (j, c.outer))]);
+
+      vector<pair<int,int>> es;
+      for (int e = c.outer; e < c.ne; e++)
+	{
+	  int a = label[index[c.es[e].vs[0]]], b = label[index[c.es[e].vs[1]]];
+	  es.push_back (pair<int,int> (min (a, b), max (a, b)));
+	}
+      sort (es.begin (), es.end ());
+      for (size_t i = 0; i < es.size (); i++)
+	{
+	  code.push_back (es[i].first);
+	  code.push_back (es[i].second);
+	}
+
+      if (best.empty () || code < best)
+	{
+	  best = code;
+	  best_sym = sym;
+	}
+      if (sym_best.empty () || code < sym_best)
+	sym_best = code;
+    }
+
+  /* Labels the remaining inner vertices.  Returns false if the budget
+     runs out.  */
+
+  bool label_rest (void)
+    {
+      if (++steps > CANON_BUDGET)
+	return false;
+
+      int from = -1;
+      for (size_t l = 0; l < bylabel.size () && from == -1; l++)
+	for (int u : nbrs[bylabel[l]])
+	  if (label[u] < 0)
+	    {
+	      from = bylabel[l];
+	      break;
+	    }
+      if (from == -1)
+	{
+	  /* Vertices not connected to the ring keep their order.  */
+	  size_t till = bylabel.size ();
+	  for (size_t v = 0; v < label.size (); v++)
+	    if (label[v] < 0)
+	      assign (v);
+	  leaf ();
+	  while (bylabel.size () > till)
+	    unassign (bylabel.back ());
+	  return true;
+	}
+
+      vector<int> cand;
+      for (int u : nbrs[from])
+	if (label[u] < 0 && find (cand.begin (), cand.end (), u) == cand.end ())
+	  cand.push_back (u);
+      vector<vector<int>> sigs;
+      for (int u : cand)
+	sigs.push_back (signature (u));
+
+      /* Try the orders of the candidates with non-decreasing signatures.  */
+      vector<int> perm;
+      for (size_t i = 0; i < cand.size (); i++)
+	perm.push_back (i);
+      do
+	{
+	  bool sorted = true;
+	  for (size_t i = 1; i < perm.size (); i++)
+	    if (sigs[perm[i]] < sigs[perm[i - 1]])
+	      sorted = false;
+	  if (!sorted)
+	    continue;
+
+	  for (int i : perm)
+	    assign (cand[i]);
+	  bool ok = label_rest ();
+	  for (size_t i = 0; i < perm.size (); i++)
+	    unassign (bylabel.back ());
+	  if (!ok)
+	    return false;
+	} while (next_permutation (perm.begin (), perm.end ()));
+
+      return true;
+    }
+
+  /* Computes the canonical form into BEST and the symmetry of the ring
+     that achieves it into BEST_SYM.  Returns false if it is only the form
+     of the configuration as given.  */
+
+  bool canonicalize (void)
+    {
+      steps = 0;
+      best.clear ();
+      sym_codes.clear ();
+      for (int dir = 1; dir >= -1; dir -= 2)
+	for (int rot = 0; rot < c.outer; rot++)
+	  {
+	    sym = ring_symmetry{rot, dir};
+	    sym_best.clear ();
+	    label.assign (nbrs.size (), -1);
+	    bylabel.clear ();
+	    for (int j = 0; j < c.outer; j++)
+	      {
+		int v = ring_end (sym.map (j, c.outer));
+		if (label[v] < 0)
+		  assign (v);
+	      }
+	    if (!label_rest ())
+	      {
+		sym = ring_symmetry{0, 1};
+		label.assign (nbrs.size (), -1);
+		bylabel.clear ();
+		for (size_t v = 0; v < nbrs.size (); v++)
+		  assign (v);
+		best.clear ();
+		leaf ();
+		sym_codes.clear ();
+		return false;
+	      }
+	    sym_codes.push_back (make_pair (sym, sym_best));
+	  }
+
+      return true;
+    }
+};
+
+/* Returns the canonical form of C as a string, and the symmetry of the
+   ring it corresponds to in SYM.  */
+
+static string
+canonical_form (const configuration &c, ring_symmetry &sym)
+{
+  conf_labeler lb (c);
+  bool exact = lb.canonicalize ();
+  stringstream ret;
+
+  ret << (exact ? "" : "raw ") << c.outer << " " << c.ne << ":";
+  for (int x : lb.best)
+    ret << " " << x;
+  sym = lb.best_sym;
+
+  return ret.str ();
+}
+
+/* The permutations of the ring positions induced by the automorphisms of
+   a configuration, except for the identity.  */
+
+typedef vector<vector<int>> ring_group;
+
+/* Computes the ring automorphisms of C into GRP.  Two symmetries of the
+   ring that give the same canonical form differ by an automorphism.  If
+   the canonical form cannot be computed, GRP is left empty.  */
+
+static void
+ring_automorphisms (const configuration &c, ring_group &grp)
+{
+  conf_labeler lb (c);
+  int n = c.outer;
+
+  grp.clear ();
+  if (!lb.canonicalize ())
+    return;
+
+  for (size_t i = 0; i < lb.sym_codes.size (); i++)
+    if (lb.sym_codes[i].second == lb.best)
+      {
+	const ring_symmetry &s = lb.sym_codes[i].first;
+	vector<int> perm (n);
+	bool identity = true;
+	for (int j = 0; j < n; j++)
+	  {
+	    perm[lb.best_sym.map (j, n)] = s.map (j, n);
+	    identity = identity && lb.best_sym.map (j, n) == s.map (j, n);
+	  }
+	if (!identity)
+	  grp.push_back (perm);
+      }
+}
+
+/* For each edge, bits 0-2 of its mask are the colors still available for
+   it.  Once the edge is assigned a color, COLORED is set and only the bit
+   of that color remains.  */
+
+#define COLORED 8
+
+static const int ncolors[8] = {0, 1, 1, 2, 1, 2, 2, 3};
+
+struct ustel
+{
+  int v;
+  unsigned char m;
+};
+
+/* The state of the search for extensions of precolorings of the graph G.
+   The uncolored edges are kept in doubly linked lists bucketed by the
+   number of available colors; the bucket of an edge is a function of its
+   mask, so undoing a mask change also restores the buckets.  Each thread
+   testing precolorings uses its own solver.  */
+
+struct ext_solver
+{
+  const graph &g;
+  vector<unsigned char> mask;
+  int bucket_head[4];
+  vector<int> bucket_next, bucket_prev;
+  vector<ustel> undo_stack;
+
+  ext_solver (const graph &gr) : g (gr)
+    {
+      init ();
+    }
+
+  void init (void)
+    {
+      int n = g.n;
+
+      mask.assign (n, 7);
+      bucket_next.resize (n);
+      bucket_prev.resize (n);
+      for (int b = 0; b < 4; b++)
+	bucket_head[b] = -1;
+      for (int v = n - 1; v >= 0; v--)
+	bucket_link (v);
+      undo_stack.clear ();
+    }
+
+  void bucket_link (int v)
+    {
+      if (mask[v] & COLORED)
+	return;
+
+      int b = ncolors[mask[v]];
+      bucket_prev[v] = -1;
+      bucket_next[v] = bucket_head[b];
+      if (bucket_head[b] != -1)
+	bucket_prev[bucket_head[b]] = v;
+      bucket_head[b] = v;
+    }
+
+  void bucket_unlink (int v)
+    {
+      if (mask[v] & COLORED)
+	return;
+
+      int b = ncolors[mask[v]];
+      if (bucket_prev[v] != -1)
+	bucket_next[bucket_prev[v]] = bucket_next[v];
+      else
+	bucket_head[b] = bucket_next[v];
+      if (bucket_next[v] != -1)
+	bucket_prev[bucket_next[v]] = bucket_prev[v];
+    }
+
+  void set_mask (int v, unsigned char m)
+    {
+      undo_stack.push_back (ustel{v, mask[v]});
+      bucket_unlink (v);
+      mask[v] = m;
+      bucket_link (v);
+    }
+
+  void undo_till (size_t till)
+    {
+      while (undo_stack.size () > till)
+	{
+	  ustel &lst = undo_stack.back ();
+	  bucket_unlink (lst.v);
+	  mask[lst.v] = lst.m;
+	  bucket_link (lst.v);
+	  undo_stack.pop_back ();
+	}
+    }
+
+  bool color_available (int v, int c)
+    {
+      return (mask[v] & (1 << c)) != 0;
+    }
+
+  void prune_color (int v, int c)
+    {
+      if ((mask[v] & (COLORED | (1 << c))) != (1 << c))
+	return;
+
+      set_mask (v, mask[v] & ~(1 << c));
+    }
+
+  void set_color (int v, int c)
+    {
+      set_mask (v, COLORED | (1 << c));
+      for (int i = g.start[v]; i < g.start[v + 1]; i++)
+	prune_color (g.adj[i], c);
+    }
+
+  int find_constrained_vertex (void)
+    {
+      for (int b = 0; b < 4; b++)
+	if (bucket_head[b] != -1)
+	  return bucket_head[b];
+
+      return -1;
+    }
+
+  bool try_extend (void)
+    {
+      int bv = find_constrained_vertex ();
+      if (bv == -1)
+	return true;
+
+      int c;
+      unsigned char m = mask[bv];
+      size_t till = undo_stack.size ();
+      for (c = 0; c < 3; c++)
+	if (m & (1 << c))
+	  {
+	    set_color (bv, c);
+	    if (try_extend ())
+	      return true;
+	    undo_till (till);
+	  }
+
+      return false;
+    }
+
+  bool coloring_extends (const precoloring &col)
+    {
+      int v, pc = col.size ();
+
+      init ();
+      for (v = 0; v < pc; v++)
+	{
+	  if (!color_available (v, col[v]))
+	    return false;
+	  set_color (v, col[v]);
+	}
+
+      undo_stack.clear ();
+      return try_extend ();
+    }
+
+  /* Stores the colors of all edges, once they are all colored.  */
+
+  void get_coloring (vector<unsigned char> &col)
+    {
+      col.resize (g.n);
+      for (int v = 0; v < g.n; v++)
+	col[v] = __builtin_ctz (mask[v] & 7);
+    }
+};
+
+/* The largest nogood recorded, and the number of learned nogoods above
+   which the less useful half of them is forgotten.  */
+
+#define MAX_NOGOOD_SIZE 8
+#define MAX_NOGOODS 500
+
+/* An extension solver that learns from its failures.  An assignment of
+   color c to edge v is the literal 3v + c.  Whenever a color of an edge is
+   pruned, the edges whose assignments caused it are remembered, so that on
+   a failure the search can compute the set of assignments responsible for
+   it, backjump over the decisions not involved, and record the set as a
+   nogood.  The nogoods only depend on the configuration, so they are kept
+   across the precolorings tested, and they are propagated like the
+   adjacency constraints: once all but one of their literals hold, the last
+   one is pruned.  Each nogood watches two of its literals that do not
+   hold, its first two, and is only looked at when one of them is
+   assigned.  The unassigned edges are bucketed by the number of their
+   colors as in ext_solver.
+
+   On the cylinders and on blockcntredu it is still two to four times
+   slower than ext_solver, as few searches fail and the nogoods rarely
+   prune, so it is only used with -n.  */
+
+struct nogood_solver
+{
+  const graph &g;
+  vector<int> val, pos;
+  vector<unsigned char> dom;
+  int bucket_head[4];
+  vector<int> bucket_next, bucket_prev;
+
+  /* The edges whose assignments pruned the literal L are
+     REASON_BUF[REASON_START[L]] up to REASON_BUF[REASON_START[L]
+     + REASON_LEN[L] - 1].  The reasons are pushed and popped together
+     with the trail.  */
+  vector<int> reason_buf, reason_start, reason_len;
+
+  /* The literals of the nogood I are NG_LITS[NG_START[I]] up to
+     NG_LITS[NG_START[I] + NG_LEN[I] - 1], the first two watched.
+     NG_HITS[I] counts its prunes and conflicts since the last time the
+     nogoods were reduced.  */
+  vector<int> ng_lits, ng_start, ng_len, ng_hits;
+  vector<vector<int>> watch;
+
+  /* Assigned literals, and pruned literals encoded as -1 - lit.  POS[V]
+     is the position of the assignment of V in it.  */
+  vector<int> trail;
+
+  /* The edges whose assignments caused the last failure.  */
+  vector<int> conflict;
+
+  /* Scratch buffers, and the sets of edges responsible for the failures
+     of the colors tried at each depth of the search.  */
+  vector<int> why;
+  vector<vector<int>> involved;
+
+  nogood_solver (const graph &gr) : g (gr)
+    {
+      val.assign (g.n, -1);
+      pos.resize (g.n);
+      dom.assign (g.n, 7);
+      bucket_next.resize (g.n);
+      bucket_prev.resize (g.n);
+      for (int b = 0; b < 4; b++)
+	bucket_head[b] = -1;
+      for (int v = g.n - 1; v >= 0; v--)
+	bucket_link (v);
+      reason_start.resize (3 * g.n);
+      reason_len.resize (3 * g.n);
+      watch.resize (3 * g.n);
+      involved.resize (g.n + 1);
+    }
+
+  void bucket_link (int v)
+    {
+      int b = ncolors[dom[v]];
+      bucket_prev[v] = -1;
+      bucket_next[v] = bucket_head[b];
+      if (bucket_head[b] != -1)
+	bucket_prev[bucket_head[b]] = v;
+      bucket_head[b] = v;
+    }
+
+  void bucket_unlink (int v)
+    {
+      int b = ncolors[dom[v]];
+      if (bucket_prev[v] != -1)
+	bucket_next[bucket_prev[v]] = bucket_next[v];
+      else
+	bucket_head[b] = bucket_next[v];
+      if (bucket_next[v] != -1)
+	bucket_prev[bucket_next[v]] = bucket_prev[v];
+    }
+
+  void undo_till (size_t till)
+    {
+      while (trail.size () > till)
+	{
+	  int e = trail.back ();
+	  trail.pop_back ();
+	  if (e >= 0)
+	    {
+	      val[e / 3] = -1;
+	      bucket_link (e / 3);
+	    }
+	  else
+	    {
+	      int v = (-1 - e) / 3;
+	      bucket_unlink (v);
+	      dom[v] |= 1 << ((-1 - e) % 3);
+	      bucket_link (v);
+	      reason_buf.resize (reason_start[-1 - e]);
+	    }
+	}
+    }
+
+  /* Prunes the color C of the unassigned edge V, because of the
+     assignments of the N edges in W.  */
+
+  bool prune (int v, int c, const int *w, int n)
+    {
+      bucket_unlink (v);
+      dom[v] &= ~(1 << c);
+      bucket_link (v);
+      reason_start[3 * v + c] = reason_buf.size ();
+      reason_len[3 * v + c] = n;
+      reason_buf.insert (reason_buf.end (), w, w + n);
+      trail.push_back (-1 - (3 * v + c));
+      if (dom[v])
+	return true;
+
+      conflict.clear ();
+      for (int d = 0; d < 3; d++)
+	{
+	  const int *r = reason_buf.data () + reason_start[3 * v + d];
+	  conflict.insert (conflict.end (), r, r + reason_len[3 * v + d]);
+	}
+      return false;
+    }
+
+  bool lit_true (int l)
+    {
+      return val[l / 3] == l % 3;
+    }
+
+  bool lit_false (int l)
+    {
+      return val[l / 3] != -1 ? val[l / 3] != l % 3 : !(dom[l / 3] & (1 << (l % 3)));
+    }
+
+  /* Visits the nogoods watching the literal LIT, which was just assigned.
+     Each either finds another literal to watch, or prunes its other
+     watched literal, or fails.  */
+
+  bool check_nogoods (int lit)
+    {
+      vector<int> &ws = watch[lit];
+      size_t i, j = 0;
+      bool ok = true;
+
+      for (i = 0; i < ws.size (); i++)
+	{
+	  int id = ws[i];
+	  if (!ok)
+	    {
+	      ws[j++] = id;
+	      continue;
+	    }
+
+	  int *ls = &ng_lits[ng_start[id]], n = ng_len[id];
+	  if (n > 1 && ls[0] == lit)
+	    swap (ls[0], ls[1]);
+
+	  int k;
+	  for (k = 2; k < n && lit_true (ls[k]); k++)
+	    ;
+	  if (k < n)
+	    {
+	      swap (ls[1], ls[k]);
+	      watch[ls[1]].push_back (id);
+	      continue;
+	    }
+
+	  ws[j++] = id;
+	  if (n > 1 && lit_false (ls[0]))
+	    continue;
+
+	  ng_hits[id]++;
+	  why.clear ();
+	  for (k = 1; k < n; k++)
+	    why.push_back (ls[k] / 3);
+	  if (n == 1 || lit_true (ls[0]))
+	    {
+	      if (n > 1)
+		why.push_back (ls[0] / 3);
+	      conflict = why;
+	      ok = false;
+	    }
+	  else
+	    ok = prune (ls[0] / 3, ls[0] % 3, why.data (), why.size ());
+	}
+      ws.resize (j);
+
+      return ok;
+    }
+
+  bool assign (int v, int c)
+    {
+      bucket_unlink (v);
+      val[v] = c;
+      pos[v] = trail.size ();
+      trail.push_back (3 * v + c);
+      for (int i = g.start[v]; i < g.start[v + 1]; i++)
+	{
+	  int u = g.adj[i];
+	  if (val[u] == -1 && (dom[u] & (1 << c)) && !prune (u, c, &v, 1))
+	    return false;
+	}
+
+      return check_nogoods (3 * v + c);
+    }
+
+  /* Records the assignments of the edges CS as a nogood, watching the two
+     assigned last, which are the first to be undone.  */
+
+  void learn (const vector<int> &cs)
+    {
+      if (cs.empty () || cs.size () > MAX_NOGOOD_SIZE)
+	return;
+
+      int id = ng_start.size ();
+      ng_start.push_back (ng_lits.size ());
+      ng_len.push_back (cs.size ());
+      ng_hits.push_back (0);
+      for (int u : cs)
+	ng_lits.push_back (3 * u + val[u]);
+
+      int *ls = &ng_lits[ng_start[id]], n = cs.size ();
+      for (int w = 0; w < 2 && w < n; w++)
+	{
+	  int last = w;
+	  for (int k = w + 1; k < n; k++)
+	    if (pos[ls[k] / 3] > pos[ls[last] / 3])
+	      last = k;
+	  swap (ls[w], ls[last]);
+	  watch[ls[w]].push_back (id);
+	}
+    }
+
+  /* Forgets the half of the nogoods that pruned the least, once there are
+     more than MAX_NOGOODS of them.  Only done with nothing assigned.  */
+
+  void reduce_nogoods (void)
+    {
+      int n = ng_start.size ();
+      if (n <= MAX_NOGOODS)
+	return;
+
+      vector<int> order (n);
+      for (int i = 0; i < n; i++)
+	order[i] = i;
+      stable_sort (order.begin (), order.end (), [&] (int a, int b)
+	{
+	  return ng_hits[a] > ng_hits[b];
+	});
+      order.resize (n / 2);
+      sort (order.begin (), order.end ());
+
+      vector<int> lits, start, len, hits;
+      for (int id : order)
+	{
+	  start.push_back (lits.size ());
+	  len.push_back (ng_len[id]);
+	  hits.push_back (ng_hits[id] / 2);
+	  lits.insert (lits.end (), ng_lits.begin () + ng_start[id],
+		       ng_lits.begin () + ng_start[id] + ng_len[id]);
+	}
+      ng_lits.swap (lits);
+      ng_start.swap (start);
+      ng_len.swap (len);
+      ng_hits.swap (hits);
+
+      for (vector<int> &ws : watch)
+	ws.clear ();
+      for (size_t id = 0; id < ng_start.size (); id++)
+	for (int w = 0; w < 2 && w < ng_len[id]; w++)
+	  watch[ng_lits[ng_start[id] + w]].push_back (id);
+    }
+
+  bool search (size_t depth)
+    {
+      int bv = -1;
+      for (int b = 1; b < 4 && bv == -1; b++)
+	bv = bucket_head[b];
+      if (bv == -1)
+	return true;
+
+      vector<int> &cs = involved[depth];
+      cs.clear ();
+
+      unsigned char m = dom[bv];
+      for (int c = 0; c < 3; c++)
+	if (m & (1 << c))
+	  {
+	    size_t till = trail.size ();
+	    if (assign (bv, c) && search (depth + 1))
+	      return true;
+	    undo_till (till);
+
+	    /* If BV is not involved, none of its other colors can help.  */
+	    if (find (conflict.begin (), conflict.end (), bv) == conflict.end ())
+	      return false;
+	    for (int u : conflict)
+	      if (u != bv)
+		cs.push_back (u);
+	  }
+      for (int c = 0; c < 3; c++)
+	if (!(m & (1 << c)))
+	  {
+	    const int *r = reason_buf.data () + reason_start[3 * bv + c];
+	    cs.insert (cs.end (), r, r + reason_len[3 * bv + c]);
+	  }
+
+      sort (cs.begin (), cs.end ());
+      cs.erase (unique (cs.begin (), cs.end ()), cs.end ());
+      learn (cs);
+      conflict = cs;
+      return false;
+    }
+
+  bool coloring_extends (const precoloring &col)
+    {
+      int v, pc = col.size ();
+
+      undo_till (0);
+      reduce_nogoods ();
+      for (v = 0; v < pc; v++)
+	if (!(dom[v] & (1 << col[v])) || !assign (v, col[v]))
+	  return false;
+
+      return search (0);
+    }
+};
+
+static void
+canonicalize (precoloring &pc)
+{
+  int mapsto[3] = {-1, -1, -1};
+  int m = 0;
+
+  for (precoloring::iterator c = pc.begin (); c != pc.end (); c++)
+    {
+      if (mapsto[*c] != -1)
+	{
+	  *c = mapsto[*c];
+	  continue;
+	}
+      mapsto[*c] = m;
+      *c = m;
+      m++;
+    }
+}
+
+/* The precolorings found to be extendable and non-extendable, each in the
+   order in which they were enumerated.  */
+
+struct ext_partition
+{
+  vector<precoloring> ext, nonext;
+
+  /* The number of extendable precolorings.  Unless KEEP_EXT is set, they
+     are only counted and not stored in EXT.  */
+  size_t n_ext;
+  bool keep_ext;
+
+  /* If not NULL, only the smallest precoloring of each orbit under these
+     ring automorphisms is tested, and the result is recorded for the whole
+     orbit.  */
+  const ring_group *autos;
+
+  ext_partition (void)
+    {
+      autos = NULL;
+      n_ext = 0;
+      keep_ext = true;
+    }
+
+  void add_ext (const vector<precoloring> &cols)
+    {
+      n_ext += cols.size ();
+      if (keep_ext)
+	ext.insert (ext.end (), cols.begin (), cols.end ());
+    }
+};
+
+/* Returns false if COL is not the smallest precoloring in its orbit under
+   RES.autos, otherwise stores the orbit into ORB.  */
+
 static bool
-at_same_vertex (const configuration &c, int e1, int e2)
+orbit_leader (const ext_partition &res, const precoloring &col,
+	      vector<precoloring> &orb)
+{
+  orb.assign (1, col);
+  if (!res.autos)
+    return true;
+
+  for (ring_group::const_iterator perm = res.autos->begin (); perm != res.autos->end (); perm++)
+    {
+      precoloring img (col.size ());
+      for (size_t i = 0; i < col.size (); i++)
+	img[(*perm)[i]] = col[i];
+      canonicalize (img);
+      if (img < col)
+	return false;
+      orb.push_back (img);
+    }
+  sort (orb.begin (), orb.end ());
+  orb.erase (unique (orb.begin (), orb.end ()), orb.end ());
+
+  return true;
+}
+
+/* Advances COL to the next canonical precoloring in the lexicographic
+   order that keeps its first FIXED colors.  Returns false if there is
+   none.  */
+
+static bool
+next_precoloring (precoloring &col, size_t fixed)
+{
+  int n = col.size ();
+  vector<int> prefix_max (n);
+  int mx = -1;
+
+  for (int i = 0; i < n; i++)
+    {
+      prefix_max[i] = mx;
+      mx = max (mx, col[i]);
+    }
+  for (int i = n - 1; i >= (int) fixed; i--)
+    if (col[i] < min (2, prefix_max[i] + 1))
+      {
+	col[i]++;
+	for (int j = i + 1; j < n; j++)
+	  col[j] = 0;
+	return true;
+      }
+
+  return false;
+}
+
+/* Tests all precolorings with the prefix COL.  The enumeration is
+   iterative, so it does not recurse per ring edge.  */
+
+template <class solver>
+static void
+test_colorings (solver &s, const precoloring &col, size_t outer,
+		ext_partition &res)
+{
+  precoloring cur (col);
+
+  cur.resize (outer, 0);
+  do
+    {
+      vector<precoloring> orb;
+      if (bad_parity (cur) || !orbit_leader (res, cur, orb))
+	continue;
+      if (s.coloring_extends (cur))
+	res.add_ext (orb);
+      else
+	res.nonext.insert (res.nonext.end (), orb.begin (), orb.end ());
+    } while (next_precoloring (cur, col.size ()));
+}
+
+/* Collects the canonical parity-valid colorings of the ring into RINGS, in
+   the order in which test_colorings visits them.  */
+
+static void
+gen_ring_colorings (precoloring &col, size_t outer, int mx,
+		    vector<precoloring> &rings)
+{
+  if (col.size () == outer)
+    {
+      if (!bad_parity (col))
+	rings.push_back (col);
+      return;
+    }
+
+  for (int c = 0; c <= mx && c < 3; c++)
+    {
+      col.push_back (c);
+      gen_ring_colorings (col, outer, c == mx ? mx + 1 : mx, rings);
+      col.pop_back ();
+    }
+}
+
+/* The largest number of states the dynamic programming in
+   test_colorings_dp keeps at once before giving up.  */
+
+#define DP_MAX_STATES (1 << 22)
+
+/* Orders the edges of the configuration for test_colorings_dp, starting
+   with the edge FIRST and then always adding the edge adjacent to the
+   added ones that grows the state least, counting the ring edges, which
+   stay in it, and the added inner edges with a neighbor not added yet.
+   Ties go to the edge with the most neighbors added.  Returns the largest
+   number of edges in a state, and the sum over all states in AREA.  */
+
+static int
+dp_order (const graph &g, int ring, int first, vector<int> &order,
+	  int &area)
+{
+  int n = g.n, v, i, width = 0, w = 0;
+  vector<int> nadded (n, 0);
+  vector<bool> added (n, false);
+
+  order.clear ();
+  area = 0;
+  for (int k = 0; k < n; k++)
+    {
+      int bv = first, bgrow = n, bnadded = -1;
+      if (k > 0)
+	for (v = 0; v < n; v++)
+	  if (!added[v] && nadded[v] > 0)
+	    {
+	      int grow = v < ring || nadded[v] < g.start[v + 1] - g.start[v];
+	      for (i = g.start[v]; i < g.start[v + 1]; i++)
+		{
+		  int u = g.adj[i];
+		  grow -= u >= ring && added[u]
+			  && nadded[u] == g.start[u + 1] - g.start[u] - 1;
+		}
+	      if (grow < bgrow || (grow == bgrow && nadded[v] > bnadded))
+		{
+		  bv = v;
+		  bgrow = grow;
+		  bnadded = nadded[v];
+		}
+	    }
+      if (bnadded < 0 && k > 0)
+	for (bv = 0; added[bv]; bv++)
+	  ;
+      order.push_back (bv);
+      added[bv] = true;
+      w += bv < ring || nadded[bv] < g.start[bv + 1] - g.start[bv];
+      for (i = g.start[bv]; i < g.start[bv + 1]; i++)
+	{
+	  int u = g.adj[i];
+	  nadded[u]++;
+	  w -= u >= ring && added[u]
+	       && nadded[u] == g.start[u + 1] - g.start[u];
+	}
+      width = max (width, w);
+      area += w;
+    }
+
+  return width;
+}
+
+/* Renames the colors of the state ST, kept as 2-bit fields with 0 for an
+   empty one, in the order of their first occurrence.  The renaming of the
+   colors of a coloring is a coloring, so only these states are kept.  */
+
+static inline uint64_t
+dp_canonical (uint64_t st)
+{
+  int name[4] = {0, 0, 0, 0}, next = 1;
+  uint64_t res = 0;
+
+  for (int b = 0; st >> b; b += 2)
+    {
+      int c = (st >> b) & 3;
+      if (c && !name[c])
+	name[c] = next++;
+      res |= (uint64_t) name[c] << b;
+    }
+
+  return res;
+}
+
+/* Computes the extendable ring colorings of the configuration all at once
+   by dynamic programming over an elimination order of its line graph.
+   The edges are added one by one in the order of dp_order, and a state
+   holds the colors of the ring edges added so far and of the frontier,
+   i.e. the added inner edges with a neighbor not added yet.  The ring
+   edges come in only when the order reaches them, so the precolorings
+   share the work for the edges added before they differ, and they stay
+   in the state, as they are the result.  The order is tried from every
+   edge and the narrowest one is used, the one with the fewest edges in
+   its states in total among those.
+
+   Returns false without doing anything if a state does not fit in 64 bits
+   or there are more than DP_MAX_STATES of them at some point.  */
+
+static bool
+test_colorings_dp (const graph &g, size_t outer, ext_partition &res)
+{
+  int n = g.n, ring = outer;
+  vector<int> order, o;
+  int v, i, width = 33, area = 0;
+
+  for (v = 0; v < n; v++)
+    {
+      int a, w = dp_order (g, ring, v, o, a);
+      if (w < width || (w == width && a < area))
+	{
+	  width = w;
+	  area = a;
+	  order.swap (o);
+	}
+    }
+  if (width > 32)
+    return false;
+
+  /* The ring edge V is kept in the bits 2V and 2V + 1 of a state, and the
+     frontier edge U in the slot SLOT[U] above them.  */
+  vector<uint64_t> states (1, 0), nstates;
+  vector<int> frontier, nfrontier, oldslot, slot (n, -1), nadded (n, 0);
+  vector<bool> added (n, false);
+
+  for (int bv : order)
+    {
+      added[bv] = true;
+      for (i = g.start[bv]; i < g.start[bv + 1]; i++)
+	nadded[g.adj[i]]++;
+
+      /* The new frontier keeps the old edges that still have a neighbor
+	 not added, followed by BV if it has one.  */
+      nfrontier.clear ();
+      oldslot.clear ();
+      for (int u : frontier)
+	if (nadded[u] < g.start[u + 1] - g.start[u])
+	  {
+	    nfrontier.push_back (u);
+	    oldslot.push_back (slot[u]);
+	  }
+      bool keep = bv >= ring && nadded[bv] < g.start[bv + 1] - g.start[bv];
+      int bvbit = bv < ring ? 2 * bv : 2 * (ring + nfrontier.size ());
+      if (keep)
+	nfrontier.push_back (bv);
+
+      nstates.clear ();
+      for (uint64_t st : states)
+	{
+	  int used = 0;
+	  for (i = g.start[bv]; i < g.start[bv + 1]; i++)
+	    {
+	      int u = g.adj[i];
+	      if (u < ring)
+		used |= 1 << ((st >> (2 * u)) & 3);
+	      else if (slot[u] >= 0)
+		used |= 1 << ((st >> (2 * (ring + slot[u]))) & 3);
+	    }
+	  if ((used & 14) == 14)
+	    continue;
+
+	  uint64_t base = ring ? st & (~(uint64_t) 0 >> (64 - 2 * ring)) : 0;
+	  for (size_t s = 0; s < oldslot.size (); s++)
+	    base |= ((st >> (2 * (ring + oldslot[s]))) & 3) << (2 * (ring + s));
+	  for (int c = 1; c <= 3; c++)
+	    if (!(used & (1 << c)))
+	      nstates.push_back (dp_canonical (bv < ring || keep
+					       ? base | ((uint64_t) c << bvbit)
+					       : base));
+	}
+      sort (nstates.begin (), nstates.end ());
+      nstates.erase (unique (nstates.begin (), nstates.end ()), nstates.end ());
+      if (nstates.size () > DP_MAX_STATES)
+	return false;
+      states.swap (nstates);
+
+      for (int u : frontier)
+	slot[u] = -1;
+      frontier.swap (nfrontier);
+      for (size_t s = 0; s < frontier.size (); s++)
+	slot[frontier[s]] = s;
+    }
+
+  /* Only the ring colors remain, and the canonical precolorings name
+     them in the order of their first occurrence already.  */
+  vector<precoloring> rings;
+  precoloring col;
+  gen_ring_colorings (col, outer, 0, rings);
+  for (size_t r = 0; r < rings.size (); r++)
+    {
+      uint64_t key = 0;
+      for (v = 0; v < ring; v++)
+	key |= (uint64_t) (rings[r][v] + 1) << (2 * v);
+      if (binary_search (states.begin (), states.end (), key))
+	res.add_ext (vector<precoloring> (1, rings[r]));
+      else
+	res.nonext.push_back (rings[r]);
+    }
+
+  return true;
+}
+
+static bool dynprog, learning, symmetric, extension_only;
+static bool gauss_seidel;
+
+/* Whether lpgm starts with one chain per equation and prices in the rest
+   of the chains as they are needed.  */
+static bool column_generation;
+static int nthreads = 1;
+
+/* A part of the precoloring space for parallel testing: all precolorings
+   starting with the prefix COL.  */
+
+struct prefix_task
+{
+  precoloring col;
+  ext_partition res;
+};
+
+static void
+gen_prefixes (precoloring &col, size_t len, int mx, vector<prefix_task> &tasks)
+{
+  if (col.size () == len)
+    {
+      tasks.push_back (prefix_task{col, ext_partition ()});
+      return;
+    }
+
+  for (int c = 0; c <= mx && c < 3; c++)
+    {
+      col.push_back (c);
+      gen_prefixes (col, len, c == mx ? mx + 1 : mx, tasks);
+      col.pop_back ();
+    }
+}
+
+/* Splits the canonical precolorings by their prefixes into enough parts to
+   keep nthreads threads busy, tests them in parallel, each thread with its
+   own solver, and concatenates the results in the enumeration order.  */
+
+static void
+test_colorings_parallel (const graph &g, size_t outer, ext_partition &res)
+{
+  vector<prefix_task> tasks;
+  precoloring col;
+  size_t len = 0;
+
+  do
+    {
+      len++;
+      tasks.clear ();
+      gen_prefixes (col, len, 0, tasks);
+    } while (len < outer && tasks.size () < 16 * (size_t) nthreads);
+  for (prefix_task &t : tasks)
+    {
+      t.res.autos = res.autos;
+      t.res.keep_ext = res.keep_ext;
+    }
+
+  atomic<size_t> next (0);
+  vector<thread> workers;
+  for (int t = 0; t < nthreads; t++)
+    workers.push_back (thread ([&] ()
+      {
+	ext_solver s (g);
+	nogood_solver ns (g);
+	size_t i;
+	while ((i = next++) < tasks.size ())
+	  if (learning)
+	    test_colorings (ns, tasks[i].col, outer, tasks[i].res);
+	  else
+	    test_colorings (s, tasks[i].col, outer, tasks[i].res);
+      }));
+  for (thread &w : workers)
+    w.join ();
+
+  for (prefix_task &t : tasks)
+    {
+      res.n_ext += t.res.n_ext;
+      res.ext.insert (res.ext.end (), t.res.ext.begin (), t.res.ext.end ());
+      res.nonext.insert (res.nonext.end (),
+			 t.res.nonext.begin (), t.res.nonext.end ());
+    }
+}
+
+static void
+process_configuration (const configuration &c, bool parallel, ext_partition &res)
+{
+  graph g;
+  conf_to_graph (c, g);
+
+  ring_group autos;
+  if (symmetric && !dynprog)
+    {
+      ring_automorphisms (c, autos);
+      res.autos = &autos;
+    }
+
+  bool done = false;
+  if (dynprog)
+    {
+      done = test_colorings_dp (g, c.outer, res);
+      if (!done)
+	fprintf (stderr, "States too large or too many for the dynamic"
+		 " programming, backtracking instead\n");
+    }
+  if (!done && parallel && nthreads > 1)
+    test_colorings_parallel (g, c.outer, res);
+  else if (!done && learning)
+    {
+      nogood_solver s (g);
+      precoloring col;
+
+      test_colorings (s, col, c.outer, res);
+    }
+  else if (!done)
+    {
+      ext_solver s (g);
+      precoloring col;
+
+      test_colorings (s, col, c.outer, res);
+    }
+
+  /* The orbits are recorded when their smallest element is reached, out of
+     the order of the enumeration.  */
+  if (res.autos)
+    {
+      sort (res.ext.begin (), res.ext.end ());
+      res.ext.erase (unique (res.ext.begin (), res.ext.end ()), res.ext.end ());
+      sort (res.nonext.begin (), res.nonext.end ());
+      res.nonext.erase (unique (res.nonext.begin (), res.nonext.end ()), res.nonext.end ());
+      res.autos = NULL;
+    }
+}
+
+/* Prunes the set ACT to its largest consistent subset.  For each
+   precoloring C in the set and each color NONC, WITNESS[3 * C + NONC] is
+   the index of a matching whose swaps all stay in the set, and C is put
+   on the watch lists of all precolorings reached by them.  When a
+   precoloring is removed, only the pairs on its watch list need a new
+   witness, and their witnesses are marked by BROKEN_WITNESS.  The watch
+   lists are not cleaned when a witness changes; each entry records the
+   witness it was made for, and the stale ones are skipped.
+
+   As the set only shrinks, a matching that failed once fails for good, so
+   the search for a new witness continues after the broken one.  FAILED
+   holds the swap subset that failed last for each pair, which is tried
+   first for the next matching.  */
+
+struct consistency_pruner
 {
-  int i, j;
-  for (i = 0; i < 2; i++)
-    for (j = 0; j < 2; j++)
-      if (c.es[e1].vs[i] == c.es[e2].vs[j])
+  coloring_set &act;
+  const matching_table &mt;
+  vector<uint32_t> witness;
+  vector<uint16_t> failed;
+
+  /* WATCH_HEAD[R] is the first node of the watch list of the precoloring
+     R.  */
+  struct watch_node
+  {
+    uint32_t entry, witness, next;
+  };
+  vector<uint32_t> watch_head;
+  vector<watch_node> nodes;
+
+  vector<uint32_t> queue, broken, reached;
+
+  consistency_pruner (coloring_set &a)
+    : act (a), mt (ring_matchings (a.idx->n))
+    {
+      witness.assign (3 * act.end (), NO_WITNESS);
+      failed.assign (3 * act.end (), 0);
+      watch_head.assign (act.end (), NO_WITNESS);
+    }
+
+  /* Looks for a witness of the pair C, NONC and returns true if there is
+     one.  */
+
+  bool check (uint32_t c, int nonc)
+    {
+      uint32_t lo, hi, mask;
+      uint32_t &w = witness[3 * c + nonc];
+
+      act.idx->unrank_packed (c, lo, hi);
+      mask = complcol_positions (lo, hi, act.idx->n, nonc);
+      if (__builtin_popcount (mask) <= 2)
 	return true;
-  return false;
+
+      uint32_t from = w == NO_WITNESS ? 0 : (w & ~BROKEN_WITNESS) + 1;
+      for (uint32_t i = from; i < mt.count[mask]; i++)
+	{
+	  reached.clear ();
+	  if (all_swaps_in_set (act, lo, hi, mt.get (mask, i), nonc, &reached,
+				&failed[3 * c + nonc]))
+	    {
+	      w = i;
+	      sort (reached.begin (), reached.end ());
+	      reached.erase (unique (reached.begin (), reached.end ()), reached.end ());
+	      for (size_t k = 0; k < reached.size (); k++)
+		if (reached[k] != c)
+		  {
+		    watch_node nd = {3 * c + nonc, w, watch_head[reached[k]]};
+		    watch_head[reached[k]] = nodes.size ();
+		    nodes.push_back (nd);
+		  }
+	      return true;
+	    }
+	}
+
+      w = NO_WITNESS;
+      return false;
+    }
+
+  bool check (uint32_t c)
+    {
+      return check (c, 0) && check (c, 1) && check (c, 2);
+    }
+
+  void run (void)
+    {
+      for (size_t r = act.next (0); r < act.end (); r = act.next (r + 1))
+	if (!check (r))
+	  queue.push_back (r);
+
+      /* The removals are done first and the broken witnesses only
+	 collected, so that the new witnesses are looked for in a set as
+	 small as possible.  */
+      for (;;)
+	{
+	  while (!queue.empty ())
+	    {
+	      uint32_t x = queue.back ();
+	      queue.pop_back ();
+	      if (!act.contains (x))
+		continue;
+
+	      act.erase (x);
+	      for (uint32_t k = watch_head[x]; k != NO_WITNESS; k = nodes[k].next)
+		{
+		  const watch_node &nd = nodes[k];
+		  if (witness[nd.entry] == nd.witness)
+		    {
+		      witness[nd.entry] |= BROKEN_WITNESS;
+		      broken.push_back (nd.entry);
+		    }
+		}
+	    }
+	  if (broken.empty ())
+	    break;
+
+	  uint32_t e = broken.back ();
+	  broken.pop_back ();
+	  if (act.contains (e / 3) && !check (e / 3, e % 3))
+	    queue.push_back (e / 3);
+	}
+    }
+};
+
+struct lpgm
+{
+  GRBModel *pgm;
+  const coloring_index *idx;
+  const matching_table *mt;
+  bool verbose;
+
+  /* The variables and their keys (see chain_key), by their indices, and
+     the index of each key.  Only the variables with IN_MODEL set are in
+     the model.  */
+  vector<GRBVar> vars;
+  vector<uint64_t> keys;
+  unordered_map<uint64_t,uint32_t> key_index;
+  vector<char> in_model;
+
+  /* The equations, in the compressed sparse row form: equation C says
+     that the variable ROW_VARS[ROW_START[C]] of a precoloring is the sum
+     of the variables of its chains, ROW_VARS[ROW_START[C] + 1] up to
+     ROW_VARS[ROW_START[C + 1] - 1].  CONSTRS are their constraints.  */
+  vector<uint32_t> row_start, row_vars;
+  vector<GRBConstr> constrs;
+
+  /* With column_generation, the equations of the chain V are
+     COL_ROWS[COL_START[V]] up to COL_ROWS[COL_START[V + 1] - 1].  */
+  vector<uint32_t> col_start, col_rows;
+
+  lpgm (GRBEnv &env, const coloring_set &with, bool verb,
+	const vector<uint32_t> *witness = NULL)
+    {
+      pgm = new GRBModel (env);
+      verbose = verb;
+      gen_equations (with, 0, witness);
+      pgm->set (GRB_IntAttr_ModelSense, GRB_MAXIMIZE);
+    }
+
+  /* A copy of the updated model O in the environment ENV, for another
+     thread.  */
+
+  lpgm (GRBEnv &env, const lpgm &o)
+    {
+      pgm = new GRBModel (*o.pgm, env);
+      idx = o.idx;
+      mt = o.mt;
+      verbose = false;
+      keys = o.keys;
+      key_index = o.key_index;
+      in_model = o.in_model;
+      row_start = o.row_start;
+      row_vars = o.row_vars;
+      col_start = o.col_start;
+      col_rows = o.col_rows;
+
+      GRBVar *vs = pgm->getVars ();
+      for (size_t v = 0; v < o.vars.size (); v++)
+	vars.push_back (in_model[v] ? vs[o.vars[v].index ()] : GRBVar ());
+      delete[] vs;
+      GRBConstr *cs = pgm->getConstrs ();
+      constrs.assign (cs, cs + o.constrs.size ());
+      delete[] cs;
+    }
+
+  ~lpgm(void)
+    {
+      delete pgm;
+    }
+
+  /* Returns the index of the variable with KEY, giving it the next one
+     if it has none yet.  */
+
+  uint32_t key_var (uint64_t key)
+    {
+      pair<unordered_map<uint64_t,uint32_t>::iterator,bool> it
+	= key_index.insert (make_pair (key, (uint32_t) keys.size ()));
+      if (it.second)
+	keys.push_back (key);
+      return it.first->second;
+    }
+
+  /* Returns the variable of the precoloring number R, adding it to the
+     model if it has none.  */
+
+  GRBVar coloring_var (size_t r)
+    {
+      uint32_t v = key_var (r);
+      if (v == vars.size ())
+	{
+	  vars.push_back (pgm->addVar (0, GRB_INFINITY, 0, GRB_CONTINUOUS));
+	  in_model.push_back (1);
+	}
+      return vars[v];
+    }
+
+  size_t row_end (size_t c) const
+    {
+      return c + 1 < row_start.size () ? row_start[c + 1] : row_vars.size ();
+    }
+
+  string row_name (size_t c) const
+    {
+      string name = key_name (keys[row_vars[row_start[c]]], *idx, *mt) + " = ";
+      const char *sep = "";
+
+      for (size_t k = row_start[c] + 1; k < row_end (c); k++)
+	{
+	  name += sep + key_name (keys[row_vars[k]], *idx, *mt);
+	  sep = " + ";
+	}
+      return name;
+    }
+
+  /* Adds the equation of the precoloring number R, packed into LO and HI,
+     and NONC.  If WITNESS is not NULL, it is the witness array of the
+     consistency_pruner that pruned WITH, so the matchings before the
+     witness are known to take R out of WITH and the witness itself is
+     known to keep it in.  */
+
+  void gen_equations_complcol (const coloring_set &with, size_t r, uint32_t lo,
+			       uint32_t hi, int nonc,
+			       const vector<uint32_t> *witness)
+    {
+      uint32_t mask = complcol_positions (lo, hi, idx->n, nonc);
+      if (__builtin_popcount (mask) <= 2)
+	return;
+
+      uint32_t from = 0;
+      bool known = false;
+      if (witness)
+	{
+	  uint32_t w = (*witness)[3 * r + nonc];
+	  if (w != NO_WITNESS && !(w & BROKEN_WITNESS))
+	    {
+	      from = w;
+	      known = true;
+	    }
+	}
+
+      row_start.push_back (row_vars.size ());
+      row_vars.push_back (key_var (r));
+      uint16_t failed = 0;
+      for (uint32_t i = from; i < mt->count[mask]; i++)
+	if ((known && i == from)
+	    || all_swaps_in_set (with, lo, hi, mt->get (mask, i), nonc, NULL,
+				 &failed))
+	  row_vars.push_back (key_var (chain_key (lo, hi, mask, i,
+						  mt->get (mask, i))));
+      if (verbose)
+	printf ("%s\n", row_name (row_start.size () - 1).c_str ());
+    }
+
+  /* Generates the equations for the precolorings of WITH and adds them to
+     the model in bulk, with the variables of the precolorings of WITH
+     bounded from below by COL_LB.  With column_generation, only the
+     first chain of each equation is added, which is its witness if
+     WITNESS is given; the rest are left to price_chains.  The names are
+     only generated for the dumps.  WITNESS is as in
+     gen_equations_complcol.  */
+
+  void gen_equations (const coloring_set &with, double col_lb,
+		      const vector<uint32_t> *witness)
+    {
+      idx = with.idx;
+      mt = idx ? &ring_matchings (idx->n) : NULL;
+      if (!idx)
+	return;
+
+      for (size_t r = with.next (0); r < with.end (); r = with.next (r + 1))
+	{
+	  uint32_t lo, hi;
+
+	  idx->unrank_packed (r, lo, hi);
+	  for (int nonc = 0; nonc < 3; nonc++)
+	    gen_equations_complcol (with, r, lo, hi, nonc, witness);
+	}
+
+      size_t nrows = row_start.size ();
+      in_model.resize (keys.size ());
+      for (size_t v = 0; v < keys.size (); v++)
+	in_model[v] = !column_generation || (keys[v] >> 32) == 0;
+      for (size_t c = 0; c < nrows; c++)
+	if (row_end (c) > row_start[c] + 1)
+	  in_model[row_vars[row_start[c] + 1]] = 1;
+
+      vector<double> lb;
+      for (size_t r = with.next (0); r < with.end (); r = with.next (r + 1))
+	{
+	  uint32_t v = key_var (r);
+	  if (lb.size () <= v)
+	    lb.resize (keys.size (), 0);
+	  lb[v] = col_lb;
+	}
+      lb.resize (keys.size (), 0);
+
+      vector<uint32_t> added;
+      for (size_t v = 0; v < keys.size (); v++)
+	if (in_model[v])
+	  {
+	    lb[added.size ()] = lb[v];
+	    added.push_back (v);
+	  }
+      GRBVar *vs = pgm->addVars (lb.data (), NULL, NULL, NULL, NULL,
+				 added.size ());
+      vars.assign (keys.size (), GRBVar ());
+      for (size_t i = 0; i < added.size (); i++)
+	vars[added[i]] = vs[i];
+      delete[] vs;
+      pgm->update ();
+
+      vector<GRBLinExpr> exprs (nrows);
+      vector<GRBVar> rvars;
+      vector<double> coeffs;
+      for (size_t c = 0; c < nrows; c++)
+	{
+	  rvars.clear ();
+	  coeffs.clear ();
+	  for (size_t k = row_start[c]; k < row_end (c); k++)
+	    if (in_model[row_vars[k]])
+	      {
+		rvars.push_back (vars[row_vars[k]]);
+		coeffs.push_back (k == row_start[c] ? -1 : 1);
+	      }
+	  exprs[c].addTerms (coeffs.data (), rvars.data (), rvars.size ());
+	}
+      vector<char> senses (nrows, GRB_EQUAL);
+      vector<double> rhs (nrows, 0);
+      GRBConstr *cs = pgm->addConstrs (exprs.data (), senses.data (),
+				       rhs.data (), NULL, nrows);
+      constrs.assign (cs, cs + nrows);
+      delete[] cs;
+
+      if (!column_generation)
+	return;
+
+      col_start.assign (keys.size () + 1, 0);
+      for (size_t c = 0; c < nrows; c++)
+	for (size_t k = row_start[c] + 1; k < row_end (c); k++)
+	  col_start[row_vars[k] + 1]++;
+      for (size_t v = 0; v < keys.size (); v++)
+	col_start[v + 1] += col_start[v];
+      col_rows.resize (col_start[keys.size ()]);
+      vector<uint32_t> fill (col_start.begin (), col_start.end () - 1);
+      for (size_t c = 0; c < nrows; c++)
+	for (size_t k = row_start[c] + 1; k < row_end (c); k++)
+	  col_rows[fill[row_vars[k]]++] = c;
+    }
+
+  /* Adds the chains that are not in the model and have a positive reduced
+     cost in its optimum to it, in bulk.  A chain has no objective and
+     the coefficient 1 in each of its equations, so its reduced cost is
+     minus the sum of their duals.  Returns the number of chains added.  */
+
+  size_t price_chains (void)
+    {
+      double *pi = pgm->get (GRB_DoubleAttr_Pi, constrs.data (),
+			     constrs.size ());
+      vector<uint32_t> added;
+      vector<GRBColumn> cols;
+
+      for (size_t v = 0; v < keys.size (); v++)
+	{
+	  if (in_model[v])
+	    continue;
+
+	  double rc = 0;
+	  for (size_t k = col_start[v]; k < col_start[v + 1]; k++)
+	    rc -= pi[col_rows[k]];
+	  if (rc <= 1e-6)
+	    continue;
+
+	  added.push_back (v);
+	  cols.push_back (GRBColumn ());
+	  for (size_t k = col_start[v]; k < col_start[v + 1]; k++)
+	    cols.back ().addTerm (1, constrs[col_rows[k]]);
+	}
+      delete[] pi;
+      if (added.empty ())
+	return 0;
+
+      GRBVar *vs = pgm->addVars (NULL, NULL, NULL, NULL, NULL, cols.data (),
+				 added.size ());
+      for (size_t i = 0; i < added.size (); i++)
+	{
+	  vars[added[i]] = vs[i];
+	  in_model[added[i]] = 1;
+	}
+      delete[] vs;
+      if (verbose)
+	printf ("Priced in %d chains\n", (int) added.size ());
+      return added.size ();
+    }
+
+  /* Optimizes the model.  With column_generation, the chains are priced
+     in until none has a positive reduced cost, and then the optimum is
+     also one of the model with all the chains.  */
+
+  void optimize (void)
+    {
+      pgm->optimize ();
+      while (column_generation
+	     && pgm->get (GRB_IntAttr_Status) == GRB_OPTIMAL
+	     && price_chains ())
+	pgm->optimize ();
+    }
+
+  /* Returns true if the precoloring PC is eliminated, i.e., its variable
+     is zero in every solution.  */
+
+  bool eliminates (const precoloring &pc)
+    {
+      GRBVar v = coloring_var (idx->rank (pc));
+      v.set (GRB_DoubleAttr_Obj, 1);
+      optimize ();
+      if (verbose && precoloring_name (pc) == dual_coloring)
+	dump_dual ();
+      bool ret = pgm->get (GRB_IntAttr_Status) == GRB_OPTIMAL;
+      v.set (GRB_DoubleAttr_Obj, 0);
+
+      return ret;
+    }
+
+  /* The precoloring whose dual solution is dumped with VERBOSE.  */
+  static const char *const dual_coloring;
+
+  /* Decides which of the precolorings in TODO are eliminated, adding them
+     to ELIMINATED or KEPT, with few solves.  The variables of TODO are
+     bounded by 1 and the sum of those not decided yet is maximized.  As
+     the equations are homogeneous, any solution can be scaled down to the
+     bounds, so each precoloring whose variable is positive in the optimum
+     is kept, and if none is, the optimum is zero and all the remaining
+     ones are eliminated.  The bound of a kept precoloring is dropped at
+     once, as it would also bound the precolorings tied to it.  Every
+     solve but the last one thus decides at least one precoloring, and
+     usually many.  Returns the number of solves.  */
+
+  int eliminate_all (const coloring_set &todo, coloring_set &eliminated,
+		     coloring_set &kept)
+    {
+      vector<size_t> rest;
+      vector<GRBVar> rvars;
+      precoloring pc;
+      int solves = 0;
+
+      for (size_t r = todo.next (0); r < todo.end (); r = todo.next (r + 1))
+	{
+	  rest.push_back (r);
+	  rvars.push_back (coloring_var (r));
+	  rvars.back ().set (GRB_DoubleAttr_UB, 1);
+	  rvars.back ().set (GRB_DoubleAttr_Obj, 1);
+	}
+
+      while (!rest.empty ())
+	{
+	  if (verbose)
+	    printf ("%d/%d\n", (int) (todo.size () - rest.size ()),
+		    (int) todo.size ());
+	  solves++;
+	  optimize ();
+	  if (pgm->get (GRB_IntAttr_Status) != GRB_OPTIMAL)
+	    break;
+
+	  size_t k = 0;
+	  for (size_t i = 0; i < rest.size (); i++)
+	    if (rvars[i].get (GRB_DoubleAttr_X) > 1e-6)
+	      {
+		kept.insert (rest[i]);
+		rvars[i].set (GRB_DoubleAttr_UB, GRB_INFINITY);
+		rvars[i].set (GRB_DoubleAttr_Obj, 0);
+	      }
+	    else
+	      {
+		rest[k] = rest[i];
+		rvars[k++] = rvars[i];
+	      }
+	  if (k == rest.size ())
+	    {
+	      for (size_t i = 0; i < rest.size (); i++)
+		eliminated.insert (rest[i]);
+	      k = 0;
+	    }
+	  rest.resize (k);
+	  rvars.resize (k);
+	}
+
+      for (size_t r = todo.next (0); r < todo.end (); r = todo.next (r + 1))
+	{
+	  GRBVar v = coloring_var (r);
+	  v.set (GRB_DoubleAttr_UB, GRB_INFINITY);
+	  v.set (GRB_DoubleAttr_Obj, 0);
+	}
+
+      /* If the solver failed, the rest is decided one by one.  */
+      for (size_t i = 0; i < rest.size (); i++)
+	{
+	  todo.get (rest[i], pc);
+	  solves++;
+	  if (eliminates (pc))
+	    eliminated.insert (rest[i]);
+	  else
+	    kept.insert (rest[i]);
+	}
+
+      if (verbose)
+	dump_eliminated_dual (todo, eliminated);
+
+      return solves;
+    }
+
+  /* Dumps the dual solution for dual_coloring if it is in TODO and was
+     ELIMINATED.  */
+
+  void dump_eliminated_dual (const coloring_set &todo,
+			     const coloring_set &eliminated)
+    {
+      precoloring pc;
+
+      for (size_t r = eliminated.next (0); r < eliminated.end ();
+	   r = eliminated.next (r + 1))
+	{
+	  eliminated.get (r, pc);
+	  if (todo.contains (r) && precoloring_name (pc) == dual_coloring)
+	    eliminates (pc);
+	}
+    }
+
+  void dump_dual (void)
+    {
+      GRBConstr *css = pgm->getConstrs ();
+      int n = pgm->get (GRB_IntAttr_NumConstrs);
+
+      for (int c = 0; c < n; c++)
+	{
+	  double val = css[c].get (GRB_DoubleAttr_Pi);
+	  if (abs (val) < 1e-6)
+	    continue;
+
+	  printf ("%.3f\t%s\n", val, row_name (c).c_str ());
+	}
+
+      delete[] css;
+    }
+};
+
+const char *const lpgm::dual_coloring = "1233332331";
+
+/* Prunes ACT to its largest consistent subset.  If WITNESS is not NULL,
+   the witnesses found are stored to it, for lpgm.  */
+
+static void
+prune_to_fixpoint (coloring_set &act, bool verbose,
+		   vector<uint32_t> *witness = NULL)
+{
+  if (!act.empty ())
+    {
+      consistency_pruner pr (act);
+      pr.run ();
+      if (witness)
+	witness->swap (pr.witness);
+    }
+  if (verbose)
+    printf ("Remaining non-ext: %d\n", (int) act.size ());
+}
+
+/* Returns true if the precoloring PC in WITH is consistent with it.  MT
+   are the matchings for its ring.  */
+
+static bool
+is_consistent (const coloring_set &with, const matching_table &mt,
+	       const precoloring &pc)
+{
+  uint32_t lo, hi;
+
+  pack_coloring (pc, lo, hi);
+  for (int nonc = 0; nonc < 3; nonc++)
+    {
+      uint32_t mask = complcol_positions (lo, hi, pc.size (), nonc);
+      uint16_t failed = 0;
+      uint32_t i;
+
+      if (__builtin_popcount (mask) <= 2)
+	continue;
+      for (i = 0; i < mt.count[mask]; i++)
+	if (all_swaps_in_set (with, lo, hi, mt.get (mask, i), nonc, NULL,
+			      &failed))
+	  break;
+      if (i == mt.count[mask])
+	return false;
+    }
+
+  return true;
+}
+
+/* The words of the bitmap handed out at once to a pruning thread.  */
+#define PRUNE_CHUNK 4
+
+/* Prunes ACT to its largest consistent subset in rounds, each of which
+   removes the precolorings not consistent with the set at its start.  The
+   rounds are spread over THREADS threads, taking PRUNE_CHUNK words of the
+   bitmap at a time, which read the old set and clear the bits in the new
+   one atomically.  With gauss_seidel, there is only one set, pruned in
+   place, so that a round already sees the removals made in it; this is
+   safe, since only precolorings outside of the fixpoint are ever removed,
+   and usually needs fewer rounds.  */
+
+static void
+prune_parallel (coloring_set &act, int threads, bool verbose)
+{
+  size_t before;
+
+  if (act.empty ())
+    return;
+
+  do
+    {
+      before = act.size ();
+      coloring_set old;
+      if (!gauss_seidel)
+	old = act;
+      const coloring_set &src = gauss_seidel ? act : old;
+      const matching_table &mt = ring_matchings (act.idx->n);
+      atomic<size_t> next (0);
+
+      vector<thread> workers;
+      for (int t = 0; t < threads; t++)
+	workers.push_back (thread ([&] ()
+	  {
+	    precoloring pc;
+	    size_t w;
+	    while ((w = next.fetch_add (PRUNE_CHUNK)) < src.bits.size ())
+	      {
+		size_t end = min (src.end (), (w + PRUNE_CHUNK) * 64);
+		for (size_t r = src.next (w * 64); r < end; r = src.next (r + 1))
+		  {
+		    src.get (r, pc);
+		    if (!is_consistent (src, mt, pc))
+		      act.erase_shared (r);
+		  }
+	      }
+	  }));
+      for (thread &w : workers)
+	w.join ();
+
+      act.recount ();
+      if (verbose)
+	printf ("Remaining non-ext: %d\n", (int) act.size ());
+    } while (act.size () < before);
+}
+
+/* The number of chunks of the precolorings to decide per thread in
+   lp_eliminate, and the smallest size of a chunk; deciding a chunk takes
+   at least one solve.  */
+
+#define LP_CHUNKS_PER_THREAD 4
+#define LP_MIN_CHUNK 16
+
+/* Decides the precolorings TODO by the linear program LP with THREADS
+   threads.  The model is copied for each thread, with its own Gurobi
+   environment, and the threads take chunks of TODO as they get free and
+   decide them by lpgm::eliminate_all.  The results are merged into
+   ELIMINATED and KEPT at the end.  The copies are made before the threads
+   start, since a model must not be used by several threads at once.
+   Returns the number of LP solves.  */
+
+static int
+lp_eliminate_parallel (lpgm &lp, const coloring_set &todo, int threads,
+		       coloring_set &eliminated, coloring_set &kept)
+{
+  vector<size_t> rs;
+  for (size_t r = todo.next (0); r < todo.end (); r = todo.next (r + 1))
+    rs.push_back (r);
+
+  size_t chunk = max ((size_t) LP_MIN_CHUNK,
+		      rs.size () / (LP_CHUNKS_PER_THREAD * threads));
+  atomic<size_t> next (0);
+  mutex merge_lock;
+  int solves = 0;
+
+  lp.pgm->update ();
+  vector<GRBEnv *> wenvs;
+  vector<lpgm *> wlps;
+  for (int t = 0; t < threads; t++)
+    {
+      wenvs.push_back (new GRBEnv ());
+      wenvs.back ()->set (GRB_IntParam_OutputFlag, 0);
+      wlps.push_back (new lpgm (*wenvs.back (), lp));
+    }
+
+  vector<thread> workers;
+  for (int t = 0; t < threads; t++)
+    workers.push_back (thread ([&, t] ()
+      {
+	lpgm &wlp = *wlps[t];
+	coloring_set part, elim, kp;
+	int n = todo.idx->n, wsolves = 0;
+	size_t i;
+
+	elim.init (n);
+	kp.init (n);
+	while ((i = next.fetch_add (chunk)) < rs.size ())
+	  {
+	    part.init (n);
+	    for (size_t j = i; j < rs.size () && j < i + chunk; j++)
+	      part.insert (rs[j]);
+	    wsolves += wlp.eliminate_all (part, elim, kp);
+	  }
+
+	lock_guard<mutex> l (merge_lock);
+	for (size_t r = elim.next (0); r < elim.end (); r = elim.next (r + 1))
+	  eliminated.insert (r);
+	for (size_t r = kp.next (0); r < kp.end (); r = kp.next (r + 1))
+	  kept.insert (r);
+	solves += wsolves;
+      }));
+  for (thread &w : workers)
+    w.join ();
+  for (int t = 0; t < threads; t++)
+    {
+      delete wlps[t];
+      delete wenvs[t];
+    }
+
+  if (lp.verbose)
+    lp.dump_eliminated_dual (todo, eliminated);
+  return solves;
+}
+
+/* Decides by the linear program which of the consistent precolorings CONS
+   are eliminated.  The precolorings in KNOWN_ELIM and KNOWN_KEPT are
+   taken as already decided, and the rest by lpgm::eliminate_all, in
+   THREADS threads if there is more than one.  WITNESS, if not empty, are
+   the witnesses of prune_to_fixpoint for CONS.  Returns the number of LP
+   solves.  */
+
+static int
+lp_eliminate (GRBEnv &env, const coloring_set &cons,
+	      const coloring_set &known_elim,
+	      const coloring_set &known_kept, bool verbose, int threads,
+	      const vector<uint32_t> &witness,
+	      coloring_set &eliminated, coloring_set &kept)
+{
+  coloring_set todo;
+  precoloring pc;
+
+  if (cons.empty ())
+    return 0;
+
+  todo.init (cons.idx->n);
+  for (size_t r = cons.next (0); r < cons.end (); r = cons.next (r + 1))
+    {
+      cons.get (r, pc);
+      if (known_elim.count (pc))
+	eliminated.insert (r);
+      else if (known_kept.count (pc))
+	kept.insert (r);
+      else
+	todo.insert (r);
+    }
+  if (todo.empty ())
+    return 0;
+
+  lpgm lp (env, cons, verbose, witness.empty () ? NULL : &witness);
+  if (threads > 1 && todo.size () > 1)
+    return lp_eliminate_parallel (lp, todo, threads, eliminated, kept);
+  return lp.eliminate_all (todo, eliminated, kept);
+}
+
+/* The outcome of the whole reducibility test of a configuration.  */
+
+struct reduce_result
+{
+  int ext, consistent;
+  coloring_set nonext, eliminated, kept;
+};
+
+/* Tests the configuration C: finds the non-extendable precolorings, prunes
+   them to the largest consistent subset and tries to eliminate the rest by
+   the linear program, solved in the environment ENV.  With VERBOSE, the
+   progress and the results are printed.  */
+
+static void
+reduce_configuration (const configuration &c, GRBEnv &env, bool parallel,
+		      bool verbose, reduce_result &r)
+{
+  ext_partition part;
+
+  part.keep_ext = verbose;
+  if (verbose)
+    printf ("Extends:\n");
+  process_configuration (c, parallel, part);
+  if (verbose)
+    {
+      for (vector<precoloring>::iterator pc = part.ext.begin (); pc != part.ext.end (); pc++)
+	{
+	  dump_precoloring (*pc);
+	  printf ("\n");
+	}
+      printf ("Initial non-ext: %d\n", (int) part.nonext.size ());
+    }
+  r.ext = part.n_ext;
+  r.nonext.init (c.outer);
+  r.eliminated.init (c.outer);
+  r.kept.init (c.outer);
+  for (vector<precoloring>::iterator pc = part.nonext.begin (); pc != part.nonext.end (); pc++)
+    r.nonext.insert (*pc);
+  r.consistent = 0;
+  if (extension_only)
+    return;
+
+  coloring_set act_nonext (r.nonext);
+  vector<uint32_t> witness;
+  if (parallel && nthreads > 1)
+    prune_parallel (act_nonext, nthreads, verbose);
+  else
+    prune_to_fixpoint (act_nonext, verbose, &witness);
+  r.consistent = act_nonext.size ();
+
+  coloring_set none;
+  lp_eliminate (env, act_nonext, none, none, verbose,
+		parallel ? nthreads : 1, witness, r.eliminated, r.kept);
+
+  if (verbose)
+    {
+      printf ("Eliminated:\n");
+      precoloring pc;
+      for (size_t k = r.eliminated.next (0); k < r.eliminated.end (); k = r.eliminated.next (k + 1))
+	{
+	  r.eliminated.get (k, pc);
+	  dump_precoloring (pc);
+	  printf ("\n");
+	}
+      printf ("Kept: %d\n", (int) r.kept.size ());
+    }
 }
 
-typedef struct
-{
-  vector<list<int>> adj;
-} graph;
+/* An edit of a configuration: adding an edge between the inner vertices A
+   and B, or removing or contracting the inner edge E.  */
 
-static void
-add_edge (graph &g, int v1, int v2)
+struct conf_edit
 {
-  g.adj[v1].push_back (v2);
-  g.adj[v2].push_back (v1);
-}
+  enum { ADD, REMOVE, CONTRACT } kind;
+  int e, a, b;
+};
 
-static void
-conf_to_graph (const configuration &c, graph &g)
+/* Applies the edit ED to C, giving NC.  EDGE_MAP maps each edge of NC to
+   the corresponding edge of C, or to -1 for a new one.  Returns false if
+   the edit is not possible.  */
+
+static bool
+apply_edit (const configuration &c, const conf_edit &ed, configuration &nc,
+	    vector<int> &edge_map)
 {
-  int e1, e2;
+  nc.outer = c.outer;
+  nc.es.clear ();
+  edge_map.clear ();
+
+  if (ed.kind == conf_edit::ADD)
+    {
+      if (ed.a < 0 || ed.b < 0 || ed.a == ed.b)
+	return false;
+      nc.es = c.es;
+      for (int e = 0; e < c.ne; e++)
+	edge_map.push_back (e);
+      nc.es.push_back (edge (ed.a, ed.b));
+      edge_map.push_back (-1);
+    }
+  else
+    {
+      if (ed.e < c.outer || ed.e >= c.ne)
+	return false;
+
+      int a = c.es[ed.e].vs[0], b = c.es[ed.e].vs[1];
+      for (int e = 0; e < c.ne; e++)
+	{
+	  if (e == ed.e)
+	    continue;
+
+	  edge ne = c.es[e];
+	  if (ed.kind == conf_edit::CONTRACT)
+	    for (int i = 0; i < 2; i++)
+	      if (ne.vs[i] == b)
+		ne.vs[i] = a;
+	  if (ne.vs[0] == ne.vs[1])
+	    return false;
+	  nc.es.push_back (ne);
+	  edge_map.push_back (e);
+	}
+    }
+  nc.ne = nc.es.size ();
 
-  g.adj.resize (c.ne);
-  for (e1 = 0; e1 < c.ne; e1++)
-    for (e2 = e1 + 1; e2 < c.ne; e2++)
-      if (at_same_vertex (c, e1, e2))
-	add_edge (g, e1, e2);
+  return true;
 }
 
-static vector<int> color;
-static vector<vector<int>> avail;
-static vector<int> navail;
+/* The results of the whole test of a configuration, kept so that it can be
+   redone quickly after an edit.  For each extendable precoloring, WITNESS
+   holds the colors of all edges in an extension of it.  */
 
-struct ustel
+struct conf_session
 {
-  int *w;
-  int val;
+  configuration conf;
+  map<precoloring,vector<unsigned char>> witness;
+  coloring_set nonext, consistent, eliminated, kept;
 
-  ustel (int &wh)
-    {
-      w = &wh;
-      val = wh;
-    }
+  /* What the last run had to redo.  */
+  int reverified, searched, solves;
+  bool warm_fixpoint;
 };
-static vector<ustel> undo_stack;
 
-static void
-set_with_undo (int &w, int val)
+static bool
+witness_valid (const graph &g, const vector<unsigned char> &w)
 {
-  undo_stack.push_back (ustel (w));
-  w = val;
+  for (int v = 0; v < g.n; v++)
+    {
+      if (w[v] > 2)
+	return false;
+      for (int i = g.start[v]; i < g.start[v + 1]; i++)
+	if (w[g.adj[i]] == w[v])
+	  return false;
+    }
+
+  return true;
 }
 
+/* Gives each edge of G that has no color in W yet (the color 3) a color
+   that none of its neighbors has in W, if there is one.  */
+
 static void
-undo_till (size_t till)
+witness_complete (const graph &g, vector<unsigned char> &w)
 {
-  while (undo_stack.size () > till)
+  for (int v = 0; v < g.n; v++)
     {
-      ustel &lst = undo_stack.back ();
-      *lst.w = lst.val;
-      undo_stack.pop_back ();
+      if (w[v] <= 2)
+	continue;
+
+      int used = 0;
+      for (int i = g.start[v]; i < g.start[v + 1]; i++)
+	if (w[g.adj[i]] <= 2)
+	  used |= 1 << w[g.adj[i]];
+      for (int col = 0; col < 3; col++)
+	if (!(used & (1 << col)))
+	  {
+	    w[v] = col;
+	    break;
+	  }
     }
 }
 
+/* Tests the precoloring PC of the configuration of SS from scratch.  */
+
 static void
-prune_color (int v, int c)
+session_search (conf_session &ss, ext_solver &s, const precoloring &pc)
 {
-  if (color[v] >= 0 || !avail[v][c])
-    return;
-
-  set_with_undo (avail[v][c], 0);
-  set_with_undo (navail[v], navail[v] - 1);
+  ss.searched++;
+  if (s.coloring_extends (pc))
+    s.get_coloring (ss.witness[pc]);
+  else
+    ss.nonext.insert (pc);
 }
 
+/* Runs the consistency pruning and the linear program on the non-extendable
+   precolorings of SS.  OLD is the state before the edit, or NULL.  */
+
 static void
-set_color (const graph &g, int v, int c)
+session_finish (conf_session &ss, GRBEnv &env, const conf_session *old)
 {
-  set_with_undo (color[v], c);
-  const list<int> &adj = g.adj[v];
-  for (list<int>::const_iterator u = adj.begin (); u != adj.end (); u++)
-    prune_color (*u, c);
+  coloring_set none;
+  bool shrunk = old && ss.nonext.subset_of (old->nonext);
+
+  /* The largest consistent subset is monotone in the set, so if the set
+     shrunk, it lies within the old one.  */
+  ss.consistent = ss.nonext;
+  ss.warm_fixpoint = shrunk;
+  if (shrunk)
+    ss.consistent.intersect (old->consistent);
+  vector<uint32_t> witness;
+  prune_to_fixpoint (ss.consistent, false, &witness);
+
+  /* A solution of the linear program for a subset extends by zeros to a
+     solution for the whole set, so the colorings eliminated for a set
+     stay eliminated for its subsets, and the colorings kept for a subset
+     stay kept for the whole set.  */
+  ss.eliminated.init (ss.conf.outer);
+  ss.kept.init (ss.conf.outer);
+  const coloring_set *known_elim = &none, *known_kept = &none;
+  if (old && ss.consistent.subset_of (old->consistent))
+    known_elim = &old->eliminated;
+  if (old && old->consistent.subset_of (ss.consistent))
+    known_kept = &old->kept;
+  ss.solves = lp_eliminate (env, ss.consistent, *known_elim, *known_kept,
+			    false, 1, witness, ss.eliminated, ss.kept);
 }
 
-static int
-find_constrained_vertex (const graph &g)
+static void
+session_start (conf_session &ss, const configuration &c, GRBEnv &env)
 {
-  int bv = -1, cbv = 4, v;
-  int n = g.adj.size ();
+  graph g;
+  conf_to_graph (c, g);
+  ext_solver s (g);
+  precoloring pc (c.outer, 0);
 
-  for (v = 0; v < n; v++)
-    if (color[v] == -1 && navail[v] < cbv)
-      {
-	bv = v;
-	cbv = navail[v];
-      }
+  ss.conf = c;
+  ss.witness.clear ();
+  ss.nonext.init (c.outer);
+  ss.reverified = ss.searched = 0;
+  do
+    if (!bad_parity (pc))
+      session_search (ss, s, pc);
+  while (next_precoloring (pc, 0));
 
-  return bv;
+  session_finish (ss, env, NULL);
 }
 
+/* Applies the edit ED to the configuration of SS and updates the results.
+   The stored extensions are carried over to the new configuration, with
+   the new edges colored greedily, and only need to be checked; the
+   precolorings whose extension breaks are searched again.  Adding an edge
+   cannot make a non-extendable precoloring extendable, since an extension
+   would restrict to the old configuration, so in that case they are not
+   tested again.  Returns false if the edit is not possible.  */
+
 static bool
-try_extend (const graph &g)
+session_edit (conf_session &ss, const conf_edit &ed, GRBEnv &env)
 {
-  int bv = find_constrained_vertex (g);
-  if (bv == -1)
-    return true;
+  configuration nc;
+  vector<int> edge_map;
+
+  if (!apply_edit (ss.conf, ed, nc, edge_map))
+    return false;
+
+  conf_session old;
+  swap (old.nonext, ss.nonext);
+  swap (old.consistent, ss.consistent);
+  swap (old.eliminated, ss.eliminated);
+  swap (old.kept, ss.kept);
+  map<precoloring,vector<unsigned char>> old_witness;
+  old_witness.swap (ss.witness);
+
+  graph g;
+  conf_to_graph (nc, g);
+  ext_solver s (g);
+  ss.conf = nc;
+  ss.nonext.init (nc.outer);
+  ss.reverified = ss.searched = 0;
+
+  for (map<precoloring,vector<unsigned char>>::iterator w = old_witness.begin (); w != old_witness.end (); w++)
+    {
+      vector<unsigned char> nw (nc.ne);
+      for (int e = 0; e < nc.ne; e++)
+	nw[e] = edge_map[e] >= 0 ? w->second[edge_map[e]] : 3;
+      witness_complete (g, nw);
+
+      if (witness_valid (g, nw))
+	{
+	  ss.reverified++;
+	  ss.witness[w->first].swap (nw);
+	}
+      else
+	session_search (ss, s, w->first);
+    }
 
-  int c;
-  size_t till = undo_stack.size ();
-  for (c = 0; c < 3; c++)
-    if (avail[bv][c])
+  precoloring pc;
+  for (size_t r = old.nonext.next (0); r < old.nonext.end (); r = old.nonext.next (r + 1))
+    if (ed.kind == conf_edit::ADD)
+      ss.nonext.insert (r);
+    else
       {
-	set_color (g, bv, c);
-	if (try_extend (g))
-	  return true;
-	undo_till (till);
+	old.nonext.get (r, pc);
+	session_search (ss, s, pc);
       }
 
-  return false;
+  session_finish (ss, env, &old);
+  return true;
 }
 
-typedef vector<int> precoloring;
+/* Parses a comma-separated list of edits: "+a:b" adds an edge between a
+   and b, "-e" removes the edge e and "/e" contracts it.  */
 
 static bool
-coloring_extends (const graph &g, const precoloring &col)
+parse_edits (const char *spec, vector<conf_edit> &eds)
 {
-  int v, pc = col.size ();
-  int n = g.adj.size ();
+  stringstream in (spec);
+  string item;
 
-  color.clear ();
-  color.resize (n, -1);
-  navail.clear ();
-  navail.resize (n, 3);
-  avail.clear ();
-  avail.resize (n, vector<int>{1,1,1});
-  for (v = 0; v < pc; v++)
+  while (getline (in, item, ','))
     {
-      if (!avail[v][col[v]])
-	return false;
-      set_color (g, v, col[v]);
+      conf_edit ed = {conf_edit::ADD, -1, -1, -1};
+      char kind = item.empty () ? 0 : item[0];
+      const char *arg = item.c_str () + 1;
+      bool ok;
+
+      if (kind == '+')
+	ok = sscanf (arg, "%d:%d", &ed.a, &ed.b) == 2;
+      else if (kind == '-' || kind == '/')
+	{
+	  ed.kind = kind == '-' ? conf_edit::REMOVE : conf_edit::CONTRACT;
+	  ok = sscanf (arg, "%d", &ed.e) == 1;
+	}
+      else
+	ok = false;
+      if (!ok)
+	{
+	  fprintf (stderr, "Bad edit '%s'\n", item.c_str ());
+	  return false;
+	}
+      eds.push_back (ed);
     }
 
-  undo_stack.clear ();
-  return try_extend (g);
+  return true;
+}
+
+static void
+dump_session (const char *what, const conf_session &ss, double secs)
+{
+  printf ("%s: ext %d, nonext %d (%d rechecked, %d searched), consistent %d%s,"
+	  " eliminated %d, kept %d (%d LP solves), %.3f s\n",
+	  what, (int) ss.witness.size (), (int) ss.nonext.size (),
+	  ss.reverified, ss.searched, (int) ss.consistent.size (),
+	  ss.warm_fixpoint ? " (warm)" : "", (int) ss.eliminated.size (),
+	  (int) ss.kept.size (), ss.solves, secs);
 }
 
-static string
-precoloring_name (const precoloring &col)
+/* Tests C and then redoes the test after each of the edits in SPEC.  */
+
+static bool
+run_edits (const configuration &c, const char *spec)
 {
-  string ret;
+  vector<conf_edit> eds;
+  conf_session ss;
 
-  for (precoloring::const_iterator i = col.begin (); i < col.end (); i++)
-    ret.push_back ('1' + *i);
+  if (!parse_edits (spec, eds))
+    return false;
 
-  return ret;
+  auto start = chrono::steady_clock::now ();
+  session_start (ss, c, env);
+  chrono::duration<double> secs = chrono::steady_clock::now () - start;
+  dump_session ("initial", ss, secs.count ());
+
+  for (size_t i = 0; i < eds.size (); i++)
+    {
+      start = chrono::steady_clock::now ();
+      if (!session_edit (ss, eds[i], env))
+	{
+	  fprintf (stderr, "Edit %d is not possible\n", (int) i + 1);
+	  return false;
+	}
+      secs = chrono::steady_clock::now () - start;
+      dump_session (("edit " + to_string (i + 1)).c_str (), ss, secs.count ());
+    }
+
+  return true;
 }
 
+/* Generates a configuration shaped like a cylinder, to test how the tool
+   scales: a cycle of 2 * RING vertices, every other one with a ring edge,
+   LAYERS more such cycles below it, each vertex joined to the next cycle
+   above or below it alternately, and a cycle of RING vertices closing the
+   bottom.  */
+
 static void
-dump_precoloring (const precoloring &col)
+gen_cylinder (int ring, int layers, configuration &c)
 {
-  printf ("%s", precoloring_name (col).c_str ());
+  int w = 2 * ring, cap = (layers + 1) * w;
+  int i, j, k;
+
+  c.outer = ring;
+  c.es.clear ();
+  for (j = 0; j < ring; j++)
+    c.es.push_back (edge (-(j + 1), 2 * j));
+  for (i = 0; i <= layers; i++)
+    for (j = 0; j < w; j++)
+      c.es.push_back (edge (i * w + j, i * w + (j + 1) % w));
+  for (i = 0; i < layers; i++)
+    for (j = 0; j < w; j++)
+      if ((i + j) % 2 == 1)
+	c.es.push_back (edge (i * w + j, (i + 1) * w + j));
+  for (j = 0, k = 0; j < w; j++)
+    if ((layers + j) % 2 == 1)
+      c.es.push_back (edge (layers * w + j, cap + k++));
+  for (k = 0; k < ring; k++)
+    c.es.push_back (edge (cap + k, cap + (k + 1) % ring));
+  c.ne = c.es.size ();
 }
 
-static bool
-bad_parity (const precoloring &col)
+/* Writes the tables of the rings of 2 to MAXRING edges to the ring table
+   file FNAME.  The file is written under a temporary name and renamed,
+   so that runs which have the old one mapped are not disturbed.  */
+
+static void
+write_ring_array (FILE *f, const void *data, size_t bytes, uint64_t &off)
 {
-  int nc[3] = {0, 0, 0};
-  int parity = col.size () % 2;
+  static const char zeros[8] = {};
 
-  for (precoloring::const_iterator i = col.begin (); i < col.end (); i++)
-    nc[*i]++;
-  for (int i = 0; i < 3; i++)
-    if (nc[i] % 2 != parity)
-      return true;
-  return false;
+  off = ftell (f);
+  fwrite (data, 1, bytes, f);
+  fwrite (zeros, 1, (8 - bytes % 8) % 8, f);
 }
 
-static set<precoloring> nonext;
-
-static void
-test_colorings (const graph &g, precoloring &col, size_t outer, int mx)
+static bool
+write_ring_tables (const char *fname, int maxring)
 {
-  if (col.size () == outer)
+  string tmp = string (fname) + ".tmp";
+  FILE *f = fopen (tmp.c_str (), "wb");
+  if (!f)
     {
-      if (bad_parity (col))
-	return;
-      if (coloring_extends (g, col))
-	{
-	  dump_precoloring (col);
-	  printf ("\n");
-	}
-      else
-	nonext.insert (col);
-      return;
+      perror (tmp.c_str ());
+      return false;
     }
 
-  for (int c = 0; c < mx; c++)
+  ring_file_header h;
+  memcpy (h.magic, ring_file_magic, sizeof (h.magic));
+  h.version = RING_FILE_VERSION;
+  h.nrings = maxring - 1;
+  vector<ring_file_entry> es (h.nrings);
+
+  /* The entries are written again once the offsets are known.  */
+  fwrite (&h, sizeof (h), 1, f);
+  fwrite (es.data (), sizeof (ring_file_entry), es.size (), f);
+  for (int n = 2; n <= maxring; n++)
     {
-      col.push_back (c);
-      test_colorings (g, col, outer, mx);
-      col.pop_back ();
+      ring_file_entry &e = es[n - 2];
+      coloring_index idx (n);
+      matching_table mt (n);
+      vector<uint64_t> packed (idx.size);
+      precoloring pc;
+
+      for (size_t r = 0; r < idx.size; r++)
+	{
+	  uint32_t lo, hi;
+	  idx.unrank (r, pc);
+	  pack_coloring (pc, lo, hi);
+	  packed[r] = lo | (uint64_t) hi << 32;
+	}
+
+      e.n = n;
+      e.unused = 0;
+      e.size = idx.size;
+      e.npairs = mt.npairs;
+      write_ring_array (f, idx.counts, (n + 1) * 32 * 8, e.counts);
+      write_ring_array (f, idx.below, n * 32 * 3 * 8, e.below);
+      write_ring_array (f, packed.data (), idx.size * 8, e.packed);
+      write_ring_array (f, mt.offset, (1u << n) * 4, e.offset);
+      write_ring_array (f, mt.count, (1u << n) * 4, e.count);
+      write_ring_array (f, mt.pairs, mt.npairs * 4, e.pairs);
     }
-  if (mx < 3)
+  fseek (f, sizeof (h), SEEK_SET);
+  fwrite (es.data (), sizeof (ring_file_entry), es.size (), f);
+
+  if (ferror (f) | fclose (f) || rename (tmp.c_str (), fname) < 0)
     {
-      col.push_back (mx);
-      test_colorings (g, col, outer, mx + 1);
-      col.pop_back ();
+      perror (fname);
+      unlink (tmp.c_str ());
+      return false;
     }
+  return true;
 }
 
-static void
-process_configuration (const configuration &c)
+/* A catalog of configurations is a text file with one configuration per
+   line: its name, the size of the ring, the number of edges and the two
+   ends of each edge, all separated by whitespace.  As in the initializers
+   above, the ring edges come first and their outer ends are -1, -2, ...
+   Empty lines and lines starting with '#' are ignored.  */
+
+struct catalog_entry
 {
-  graph g;
-  conf_to_graph (c, g);
+  string name;
+  configuration conf;
+};
 
-  precoloring col;
-  test_colorings (g, col, c.outer, 0);
+static void
+write_catalog_entry (FILE *f, const string &name, const configuration &c)
+{
+  fprintf (f, "%s %d %d", name.c_str (), c.outer, c.ne);
+  for (vector<edge>::const_iterator e = c.es.begin (); e != c.es.end (); e++)
+    fprintf (f, "  %d %d", e->vs[0], e->vs[1]);
+  fprintf (f, "\n");
 }
 
-struct matching
+/* A parser of the mapped catalog, which is not null-terminated.  */
+
+struct catalog_reader
 {
-  vector<pair<int,int>> ps;
+  const char *p, *end;
 
-  matching (void)
+  void skip_blank (void)
     {
+      while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+	p++;
     }
 
-  matching (int a, int b, const matching &l, const matching &r)
+  bool at_eol (void)
     {
-      ps.push_back (pair<int,int>(a,b));
-      ps.insert (ps.end (), l.ps.begin (), l.ps.end ());
-      ps.insert (ps.end (), r.ps.begin (), r.ps.end ());
+      skip_blank ();
+      return p == end || *p == '\n';
     }
-};
 
-static void
-gen_matchings (const list<int> pos, list<matching> &ms)
-{
-  int n = pos.size ();
-  if (n == 0)
+  bool word (string &w)
     {
-      ms.push_back (matching ());
-      return;
+      skip_blank ();
+      const char *s = p;
+      while (p < end && !isspace ((unsigned char) *p))
+	p++;
+      w.assign (s, p);
+      return p > s;
     }
 
-  list<int> left;
-  list<int> right(pos);
-
-  list<int>::const_iterator m0 = pos.begin ();
-  m0++;
-  for (int i = 0; i < n; i += 2, m0++, m0++)
+  bool number (int &x)
     {
-      list<matching> msl, msr;
-      right.pop_front ();
-      right.pop_front ();
-      gen_matchings (left, msl);
-      gen_matchings (right, msr);
-
-      for (list<matching>::iterator l = msl.begin (); l != msl.end (); ++l)
-	for (list<matching>::iterator r = msr.begin (); r != msr.end (); ++r)
-	  ms.push_back (matching (pos.front (), *m0, *l, *r));
+      skip_blank ();
+      bool neg = p < end && *p == '-';
+      if (neg)
+	p++;
+      if (p == end || !isdigit ((unsigned char) *p))
+	return false;
+      for (x = 0; p < end && isdigit ((unsigned char) *p); p++)
+	x = 10 * x + (*p - '0');
+      if (neg)
+	x = -x;
+      return true;
+    }
 
-      left.push_back (*m0);
-      left.push_back (right.front ());
+  void next_line (void)
+    {
+      while (p < end && *p != '\n')
+	p++;
+      if (p < end)
+	p++;
     }
-}
+};
 
-static void
-swap_on_subset (const matching &m, int ss, precoloring &pc, int nonc)
+static bool
+load_catalog (const char *fname, vector<catalog_entry> &cat)
 {
-  int n = m.ps.size ();
+  int fd = open (fname, O_RDONLY);
+  struct stat st;
 
-  for (int i = 0; i < n; i++)
-    if ((ss >> i) & 1)
-      {
-	int a = m.ps[i].first;
-	int b = m.ps[i].second;
-
-	pc[a] = 3 - nonc - pc[a];
-	pc[b] = 3 - nonc - pc[b];
-      }
-}
-
-static void
-canonicalize (precoloring &pc)
-{
-  int mapsto[3] = {-1, -1, -1};
-  int m = 0;
+  if (fd < 0 || fstat (fd, &st) < 0)
+    {
+      perror (fname);
+      if (fd >= 0)
+	close (fd);
+      return false;
+    }
+  if (st.st_size == 0)
+    {
+      close (fd);
+      return true;
+    }
 
-  for (precoloring::iterator c = pc.begin (); c != pc.end (); c++)
+  void *map = mmap (NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close (fd);
+  if (map == MAP_FAILED)
     {
-      if (mapsto[*c] != -1)
-	{
-	  *c = mapsto[*c];
-	  continue;
-	}
-      mapsto[*c] = m;
-      *c = m;
-      m++;
+      perror (fname);
+      return false;
     }
-}
 
-static bool
-all_swaps_in_set (const set<precoloring> &with, const precoloring &pc, const matching &m, int nonc)
-{
-  int n = m.ps.size ();
-  for (int ss = 0; ss < (1 << n); ss++)
+  catalog_reader rd = {(const char *) map, (const char *) map + st.st_size};
+  bool ok = true;
+  for (int line = 1; rd.p < rd.end && ok; line++, rd.next_line ())
     {
-      precoloring spc(pc);
-      swap_on_subset (m, ss, spc, nonc);
-      canonicalize (spc);
-      if (with.count (spc) == 0)
-	return false;
+      if (rd.at_eol () || *rd.p == '#')
+	continue;
+
+      catalog_entry ce;
+      ok = (rd.word (ce.name)
+	    && rd.number (ce.conf.outer) && rd.number (ce.conf.ne)
+	    && ce.conf.outer > 0 && ce.conf.ne >= ce.conf.outer);
+      /* The ring edges come first, the edge E with the outer end
+	 -(E + 1), and all the other ends are inner vertices.  */
+      for (int e = 0; ok && e < ce.conf.ne; e++)
+	{
+	  int v1, v2;
+	  ok = (rd.number (v1) && rd.number (v2) && v2 >= 0
+		&& (e < ce.conf.outer ? v1 == -(e + 1) : v1 >= 0));
+	  if (ok)
+	    ce.conf.es.push_back (edge (v1, v2));
+	}
+      ok = ok && rd.at_eol ();
+      if (!ok)
+	fprintf (stderr, "%s:%d: malformed configuration\n", fname, line);
+      else if (ce.conf.outer > MAX_RING)
+	{
+	  fprintf (stderr,
+		   "%s:%d: %s: ring of %d edges, at most %d supported\n",
+		   fname, line, ce.name.c_str (), ce.conf.outer, MAX_RING);
+	  ok = false;
+	}
+      else
+	cat.push_back (ce);
     }
 
-  return true;
+  munmap (map, st.st_size);
+  return ok;
 }
 
-static bool
-is_consistent_in_complcol (const set<precoloring> &with, const precoloring &pc, int nonc)
-{
-  list<int> positions;
-  int n = pc.size ();
+/* Maps a precoloring of the ring of a configuration to the corresponding
+   precoloring of the ring transformed by SYM, or back with INVERSE.  */
 
-  for (int i = 0; i < n; i++)
-    if (pc[i] != nonc)
-      positions.push_back (i);
-  if (positions.size () <= 2)
-    return true;
+static precoloring
+transform_coloring (const precoloring &col, const ring_symmetry &sym, bool inverse)
+{
+  int n = col.size ();
+  precoloring ret (n);
 
-  list<matching> ms;
-  gen_matchings (positions, ms);
-  for (list<matching>::iterator m = ms.begin (); m != ms.end (); m++)
-    if (all_swaps_in_set (with, pc, *m, nonc))
-      return true;
+  for (int j = 0; j < n; j++)
+    if (inverse)
+      ret[sym.map (j, n)] = col[j];
+    else
+      ret[j] = col[sym.map (j, n)];
+  canonicalize (ret);
 
-  return false;
+  return ret;
 }
 
-static bool
-is_consistent (const set<precoloring> &with, const precoloring &pc)
-{
-  return (is_consistent_in_complcol (with, pc, 0)
-	  && is_consistent_in_complcol (with, pc, 1)
-	  && is_consistent_in_complcol (with, pc, 2));
-}
+/* A cache of the results of reduce_configuration, keyed by the canonical
+   forms of the configurations.  It is kept in a text file with a line per
+   configuration: the canonical form, the number of extendable
+   precolorings, and the non-extendable, eliminated and kept precolorings,
+   separated by tabs.  The precolorings are stored for the ring as
+   transformed by the canonical form.  */
 
-static string
-chain_name (const precoloring &pc, const matching &m)
+struct result_cache
 {
-  stringstream rets;
-  int n = m.ps.size ();
-  for (int i = 0; i < n; i++)
+  map<string,string> entries;
+  FILE *f;
+  mutex lock;
+
+  result_cache (void)
     {
-      int a = m.ps[i].first;
-      int b = m.ps[i].second;
-      rets << a;
-      rets << (pc[a] == pc[b] ? 'o' : 'e');
-      rets << b;
+      f = NULL;
     }
 
-  return rets.str ();
-}
-
-static map<string,GRBVar> vars;
+  ~result_cache (void)
+    {
+      if (f)
+	fclose (f);
+    }
 
-static GRBVar
-get_var (string name)
-{
-  if (vars.count (name) == 0)
-    vars[name] = pgm->addVar (0, GRB_INFINITY, 0, GRB_CONTINUOUS, name);
+  bool open (const char *fname)
+    {
+      FILE *in = fopen (fname, "r");
+      if (in)
+	{
+	  char *line = NULL;
+	  size_t len = 0;
+	  ssize_t l;
+	  while ((l = getline (&line, &len, in)) > 0)
+	    {
+	      string s (line, l);
+	      size_t tab = s.find ('\t');
+	      if (s[l - 1] != '\n' || tab == string::npos)
+		continue;
+	      entries[s.substr (0, tab)] = s.substr (tab + 1, l - tab - 2);
+	    }
+	  free (line);
+	  fclose (in);
+	}
 
-  return vars[name];
-}
+      f = fopen (fname, "a");
+      if (!f)
+	perror (fname);
+      return f != NULL;
+    }
 
-static void
-gen_equations_complcol (const set<precoloring> &with, const precoloring &pc, int nonc, bool create_vars)
-{
-  list<int> positions;
-  int n = pc.size ();
+  static void write_colorings (stringstream &out, const coloring_set &cols,
+			       const ring_symmetry &sym)
+    {
+      const char *sep = "";
+      precoloring pc;
+      out << "\t";
+      for (size_t r = cols.next (0); r < cols.end (); r = cols.next (r + 1))
+	{
+	  cols.get (r, pc);
+	  out << sep << precoloring_name (transform_coloring (pc, sym, false));
+	  sep = " ";
+	}
+    }
 
-  for (int i = 0; i < n; i++)
-    if (pc[i] != nonc)
-      positions.push_back (i);
-  if (positions.size () <= 2)
-    return;
+  static void read_colorings (stringstream &in, coloring_set &cols,
+			      const ring_symmetry &sym)
+    {
+      string field, name;
+      getline (in, field, '\t');
+      stringstream names (field);
+      while (names >> name)
+	{
+	  precoloring pc;
+	  for (char ch : name)
+	    pc.push_back (ch - '1');
+	  cols.insert (transform_coloring (pc, sym, true));
+	}
+    }
 
-  list<matching> ms;
-  gen_matchings (positions, ms);
-  GRBLinExpr cstr;
+  bool lookup (const string &key, const ring_symmetry &sym, reduce_result &r)
+    {
+      string val;
+	{
+	  lock_guard<mutex> l (lock);
+	  map<string,string>::iterator it = entries.find (key);
+	  if (it == entries.end ())
+	    return false;
+	  val = it->second;
+	}
 
-  stringstream consname;
+      stringstream in (val);
+      string ext;
+      getline (in, ext, '\t');
+      r.ext = atoi (ext.c_str ());
+      read_colorings (in, r.nonext, sym);
+      read_colorings (in, r.eliminated, sym);
+      read_colorings (in, r.kept, sym);
+      r.consistent = r.eliminated.size () + r.kept.size ();
+      return true;
+    }
 
-  string col_name = precoloring_name (pc);
-  GRBVar col_var = get_var (col_name);
-  consname << col_name << " = ";
-  if (!create_vars)
-    cstr += GRBLinExpr (col_var, -1);
-  const char *sep = "";
-  for (list<matching>::iterator m = ms.begin (); m != ms.end (); m++)
-    if (all_swaps_in_set (with, pc, *m, nonc))
-      {
-	string ch_name = chain_name (pc, *m);
-	GRBVar ch_var = get_var (ch_name);
-	consname << sep << ch_name;
-	if (!create_vars)
-	  cstr += GRBLinExpr (ch_var, 1);
-	sep = " + ";
-      }
-  if (create_vars)
-    printf ("%s\n", consname.str().c_str ());
-  else
-    pgm->addConstr (cstr, GRB_EQUAL, 0, consname.str ());
-}
+  void store (const string &key, const ring_symmetry &sym, const reduce_result &r)
+    {
+      stringstream out;
+      out << r.ext;
+      write_colorings (out, r.nonext, sym);
+      write_colorings (out, r.eliminated, sym);
+      write_colorings (out, r.kept, sym);
+
+      lock_guard<mutex> l (lock);
+      entries[key] = out.str ();
+      fprintf (f, "%s\t%s\n", key.c_str (), out.str ().c_str ());
+      fflush (f);
+    }
+};
 
-static void
-gen_equations (const set<precoloring> &with, const precoloring &pc, bool create_vars)
-{
-  gen_equations_complcol (with, pc, 0, create_vars);
-  gen_equations_complcol (with, pc, 1, create_vars);
-  gen_equations_complcol (with, pc, 2, create_vars);
-}
+/* Runs the reducibility test on all configurations of the catalog CAT,
+   spreading them over nthreads threads, each with its own Gurobi
+   environment.  One result record per configuration is written to OUT, in
+   the order of the catalog.  The configurations found in CACHE are not
+   tested again, and the results of the others are added to it.  */
 
 static void
-prune_by_consistency (const set<precoloring> &old, set<precoloring> &nw)
+reduce_catalog (const vector<catalog_entry> &cat, FILE *out, result_cache *cache)
 {
-  for (set<precoloring>::const_iterator pc = old.begin (); pc != old.end (); pc++)
-    if (is_consistent (old, *pc))
-      nw.insert (*pc);
+  vector<string> records (cat.size ());
+  vector<bool> finished (cat.size (), false);
+  size_t nwritten = 0;
+  atomic<size_t> next (0);
+  mutex out_lock;
+
+  fprintf (out, "# name\touter\tedges\text\tnonext\tconsistent\teliminated\tkept\tseconds\n");
+  fflush (out);
+
+  vector<thread> workers;
+  for (int t = 0; t < nthreads; t++)
+    workers.push_back (thread ([&] ()
+      {
+	GRBEnv wenv;
+	wenv.set (GRB_IntParam_OutputFlag, 0);
+	size_t i;
+	while ((i = next++) < cat.size ())
+	  {
+	    const catalog_entry &ce = cat[i];
+	    reduce_result r;
+	    auto start = chrono::steady_clock::now ();
+	    if (cache)
+	      {
+		ring_symmetry sym;
+		string key = canonical_form (ce.conf, sym);
+		if (!cache->lookup (key, sym, r))
+		  {
+		    reduce_configuration (ce.conf, wenv, false, false, r);
+		    /* With extension_only, the result is not complete.  */
+		    if (!extension_only)
+		      cache->store (key, sym, r);
+		  }
+	      }
+	    else
+	      reduce_configuration (ce.conf, wenv, false, false, r);
+	    chrono::duration<double> secs = chrono::steady_clock::now () - start;
+
+	    char buf[256];
+	    snprintf (buf, sizeof (buf), "\t%d\t%d\t%d\t%d\t%d\t%d\t%d\t%.3f\n",
+		      ce.conf.outer, ce.conf.ne, r.ext, (int) r.nonext.size (), r.consistent,
+		      (int) r.eliminated.size (), (int) r.kept.size (),
+		      secs.count ());
+
+	    lock_guard<mutex> lock (out_lock);
+	    records[i] = ce.name + buf;
+	    finished[i] = true;
+	    while (nwritten < cat.size () && finished[nwritten])
+	      {
+		fputs (records[nwritten].c_str (), out);
+		records[nwritten].clear ();
+		nwritten++;
+	      }
+	    fflush (out);
+	  }
+      }));
+  for (thread &w : workers)
+    w.join ();
+
+  struct rusage ru;
+  getrusage (RUSAGE_SELF, &ru);
+  fprintf (out, "# user time %.3f s, max RSS %ld KB\n",
+	   ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6, ru.ru_maxrss);
 }
 
-static void
-dump_dual (void)
+int main (int argc, char **argv)
 {
-  GRBConstr *css = pgm->getConstrs ();
-  int n = pgm->get (GRB_IntAttr_NumConstrs);
+  int opt;
+  const char *catalog = NULL, *outname = NULL, *cachename = NULL;
+  const char *edits = NULL, *tables = NULL;
+  bool print_builtin = false;
+  int gen_ring = 0, gen_layers = 0, write_tables = 0;
+
+  while ((opt = getopt (argc, argv, "C:c:dE:Gg:j:lno:pst:W:x")) != -1)
+    switch (opt)
+      {
+      case 'C':
+	cachename = optarg;
+	break;
+      case 'c':
+	catalog = optarg;
+	break;
+      case 'd':
+	dynprog = true;
+	break;
+      case 'G':
+	gauss_seidel = true;
+	break;
+      case 'E':
+	edits = optarg;
+	break;
+      case 'g':
+	if (sscanf (optarg, "%d:%d", &gen_ring, &gen_layers) != 2
+	    || gen_ring < 3 || gen_layers < 0)
+	  {
+	    fprintf (stderr, "Expected -g ring:layers\n");
+	    return 1;
+	  }
+	break;
+      case 'j':
+	nthreads = max (1, atoi (optarg));
+	break;
+      case 'l':
+	column_generation = true;
+	break;
+      case 'n':
+	learning = true;
+	break;
+      case 'o':
+	outname = optarg;
+	break;
+      case 'p':
+	print_builtin = true;
+	break;
+      case 's':
+	symmetric = true;
+	break;
+      case 't':
+	tables = optarg;
+	break;
+      case 'W':
+	write_tables = atoi (optarg);
+	if (write_tables < 2 || write_tables > MAX_RING)
+	  {
+	    fprintf (stderr, "Expected -W maxring, at most %d\n", MAX_RING);
+	    return 1;
+	  }
+	break;
+      case 'x':
+	extension_only = true;
+	break;
+      default:
+	fprintf (stderr, "Usage: %s [-dGlnpsx] [-j threads] [-g ring:layers] [-E edits]\n"
+		 "\t[-t tables [-W maxring]] [-c catalog [-o results] [-C cache]]\n",
+		 argv[0]);
+	return 1;
+      }
 
-  for (int c = 0; c < n; c++)
+  if (gen_ring)
     {
-      double val = css[c].get (GRB_DoubleAttr_Pi);
-      if (abs (val) < 1e-6)
-	continue;
-
-      printf ("%.3f\t%s\n", val, css[c].get (GRB_StringAttr_ConstrName).c_str ());
+      configuration c;
+      gen_cylinder (gen_ring, gen_layers, c);
+      write_catalog_entry (stdout, "cyl" + to_string (gen_ring) + "x" + to_string (gen_layers), c);
+      return 0;
     }
 
-  delete css;
-}
+  if (print_builtin)
+    {
+      write_catalog_entry (stdout, "birkhoffdiamond", birkhoffdiamond);
+      write_catalog_entry (stdout, "blockcntredu", blockcntredu);
+      return 0;
+    }
 
-int main (void)
-{
-  printf ("Extends:\n");
-//  process_configuration (birkhoffdiamond);
-  process_configuration (blockcntredu);
-  printf ("Initial non-ext: %d\n", (int) nonext.size ());
-  set<precoloring> act_nonext (nonext);
-  set<precoloring> prev_nonext;
-  do
+  if (write_tables)
     {
-      prev_nonext = act_nonext;
-      act_nonext.clear ();
-      prune_by_consistency (prev_nonext, act_nonext);
-      printf ("Remaining non-ext: %d\n", (int) act_nonext.size ());
-    } while (prev_nonext.size () > act_nonext.size ());
-
-  pgm = new GRBModel (env);
-  for (set<precoloring>::iterator pc = act_nonext.begin (); pc != act_nonext.end (); pc++)
-    gen_equations (act_nonext, *pc, true);
-  pgm->update ();
-  for (set<precoloring>::iterator pc = act_nonext.begin (); pc != act_nonext.end (); pc++)
-    gen_equations (act_nonext, *pc, false);
-  pgm->set (GRB_IntAttr_ModelSense, GRB_MAXIMIZE);
-  set<precoloring> eliminated;
-  set<precoloring> kept;
-  int k = 0, s = act_nonext.size ();
-  for (set<precoloring>::iterator pc = act_nonext.begin (); pc != act_nonext.end (); pc++, k++)
-    {
-      GRBVar v = get_var (precoloring_name (*pc));
-      v.set (GRB_DoubleAttr_Obj, 1);
-      printf ("%d/%d\n", k, s);
-      pgm->optimize ();
-      if (precoloring_name (*pc) == "1233332331")
-	dump_dual ();
-      if (pgm->get (GRB_IntAttr_Status) == GRB_OPTIMAL)
-	eliminated.insert (*pc);
-      else
-	kept.insert (*pc);
-      v.set (GRB_DoubleAttr_Obj, 0);
+      if (!tables)
+	{
+	  fprintf (stderr, "-W needs the ring table file given by -t\n");
+	  return 1;
+	}
+      return write_ring_tables (tables, write_tables) ? 0 : 1;
     }
+  if (tables && !map_ring_tables (tables))
+    return 1;
 
-  printf ("Eliminated:\n");
-  for (set<precoloring>::iterator pc = eliminated.begin (); pc != eliminated.end (); pc++)
+  if (catalog)
     {
-      dump_precoloring (*pc);
-      printf ("\n");
+      vector<catalog_entry> cat;
+      if (!load_catalog (catalog, cat))
+	return 1;
+
+      FILE *out = outname ? fopen (outname, "w") : stdout;
+      if (!out)
+	{
+	  perror (outname);
+	  return 1;
+	}
+      result_cache cache;
+      if (cachename && !cache.open (cachename))
+	return 1;
+      reduce_catalog (cat, out, cachename ? &cache : NULL);
+      if (out != stdout)
+	fclose (out);
+      return 0;
     }
-  printf ("Kept: %d\n", (int) kept.size ());
 
-  delete pgm;
+//  const configuration &conf = birkhoffdiamond;
+  const configuration &conf = blockcntredu;
+
+  if (edits)
+    return run_edits (conf, edits) ? 0 : 1;
+
+  reduce_result r;
+  reduce_configuration (conf, env, true, true, r);
+
   return 0;
 }
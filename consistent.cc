@@ -1,60 +1,35 @@
 #include <cstdio>
+#include <cstdint>
+#include <algorithm>
 #include <vector>
-#include <list>
-#include <set>
 #include <map>
-#include <sstream>
+#include <unordered_map>
 #include <cmath>
+#include <cstdlib>
+#include <chrono>
+#include <unistd.h>
 #include "gurobi_c++.h"
+#include "rings.h"
 using namespace std;
 
 static GRBEnv env;
 
-typedef vector<int> precoloring;
-typedef set<precoloring> potent;
-
-static string
-precoloring_name (const precoloring &col)
-{
-  string ret;
-
-  for (precoloring::const_iterator i = col.begin (); i < col.end (); i++)
-    ret.push_back ('1' + *i);
-
-  return ret;
-}
-
-static void
-dump_precoloring (const precoloring &col)
-{
-  printf ("%s", precoloring_name (col).c_str ());
-}
+typedef coloring_set potent;
 
 static void
 dump_potent (const potent &p)
 {
-  for (potent::const_iterator pc = p.begin (); pc != p.end (); pc++)
+  precoloring pc;
+
+  for (size_t r = p.next (0); r < p.end (); r = p.next (r + 1))
     {
-      dump_precoloring (*pc);
+      p.get (r, pc);
+      dump_precoloring (pc);
       printf (";");
     }
   printf ("\n");
 }
 
-static bool
-bad_parity (const precoloring &col)
-{
-  int nc[3] = {0, 0, 0};
-  int parity = col.size () % 2;
-
-  for (precoloring::const_iterator i = col.begin (); i < col.end (); i++)
-    nc[*i]++;
-  for (int i = 0; i < 3; i++)
-    if (nc[i] % 2 != parity)
-      return true;
-  return false;
-}
-
 static void
 gen_all_colorings (precoloring &col, size_t outer, int mx, potent &res)
 {
@@ -86,183 +61,213 @@ gen_all_colorings (int outer, potent &res)
   gen_all_colorings (col, outer, 0, res);
 }
 
-struct matching
+/* Prunes the set ACT to its largest consistent subset.  For each
+   precoloring C in the set and each color NONC, WITNESS[3 * C + NONC] is
+   the index of a matching whose swaps all stay in the set, and C is put
+   on the watch lists of all precolorings reached by them.  When a
+   precoloring is removed, only the pairs on its watch list need a new
+   witness, and their witnesses are marked by BROKEN_WITNESS.  The watch
+   lists are not cleaned when a witness changes; each entry records the
+   witness it was made for, and the stale ones are skipped.
+
+   As the set only shrinks, a matching that failed once fails for good, so
+   the search for a new witness continues after the broken one.  FAILED
+   holds the swap subset that failed last for each pair, which is tried
+   first for the next matching.
+
+   After run, more precolorings can be removed by remove.  If the pruner
+   is UNDOABLE, it logs its changes so that restore can return the set and
+   the witnesses to the state at a mark; this keeps the removal history
+   monotone, so the rule above still holds.  */
+
+struct consistency_pruner
 {
-  vector<pair<int,int>> ps;
-
-  matching (void)
+  potent &act;
+  const matching_table &mt;
+  vector<uint32_t> witness;
+  vector<uint16_t> failed;
+
+  /* WATCH_HEAD[R] is the first node of the watch list of the precoloring
+     R.  */
+  struct watch_node
+  {
+    uint32_t entry, witness, next;
+  };
+  vector<uint32_t> watch_head;
+  vector<watch_node> nodes;
+
+  vector<uint32_t> queue, broken, reached;
+
+  /* The removed precolorings, and the old values of the changed witnesses
+     and watch list heads, if UNDOABLE.  */
+  bool undoable;
+  vector<uint32_t> removed;
+  vector<pair<uint32_t,uint32_t> > witness_log, head_log;
+
+  struct mark
+  {
+    size_t removed, witness_log, head_log, nodes;
+  };
+
+  consistency_pruner (potent &a, bool u = false)
+    : act (a), mt (ring_matchings (a.idx->n)), undoable (u)
     {
+      witness.assign (3 * act.end (), NO_WITNESS);
+      failed.assign (3 * act.end (), 0);
+      watch_head.assign (act.end (), NO_WITNESS);
     }
 
-  matching (int a, int b, const matching &l, const matching &r)
+  void set_witness (uint32_t e, uint32_t w)
     {
-      ps.push_back (pair<int,int>(a,b));
-      ps.insert (ps.end (), l.ps.begin (), l.ps.end ());
-      ps.insert (ps.end (), r.ps.begin (), r.ps.end ());
+      if (undoable)
+	witness_log.push_back (make_pair (e, witness[e]));
+      witness[e] = w;
     }
-};
 
-static void
-gen_matchings (const list<int> pos, list<matching> &ms)
-{
-  int n = pos.size ();
-  if (n == 0)
+  void set_head (uint32_t r, uint32_t k)
     {
-      ms.push_back (matching ());
-      return;
+      if (undoable)
+	head_log.push_back (make_pair (r, watch_head[r]));
+      watch_head[r] = k;
     }
 
-  list<int> left;
-  list<int> right(pos);
+  /* Looks for a witness of the pair C, NONC and returns true if there is
+     one.  */
 
-  list<int>::const_iterator m0 = pos.begin ();
-  m0++;
-  for (int i = 0; i < n; i += 2, m0++, m0++)
+  bool check (uint32_t c, int nonc)
     {
-      list<matching> msl, msr;
-      right.pop_front ();
-      right.pop_front ();
-      gen_matchings (left, msl);
-      gen_matchings (right, msr);
-
-      for (list<matching>::iterator l = msl.begin (); l != msl.end (); ++l)
-	for (list<matching>::iterator r = msr.begin (); r != msr.end (); ++r)
-	  ms.push_back (matching (pos.front (), *m0, *l, *r));
-
-      left.push_back (*m0);
-      left.push_back (right.front ());
-    }
-}
+      uint32_t lo, hi, mask;
+      uint32_t e = 3 * c + nonc, w = witness[e];
 
-static void
-swap_on_subset (const matching &m, int ss, precoloring &pc, int nonc)
-{
-  int n = m.ps.size ();
+      act.idx->unrank_packed (c, lo, hi);
+      mask = complcol_positions (lo, hi, act.idx->n, nonc);
+      if (__builtin_popcount (mask) <= 2)
+	return true;
 
-  for (int i = 0; i < n; i++)
-    if ((ss >> i) & 1)
-      {
-	int a = m.ps[i].first;
-	int b = m.ps[i].second;
-
-	pc[a] = 3 - nonc - pc[a];
-	pc[b] = 3 - nonc - pc[b];
-      }
-}
+      uint32_t from = w == NO_WITNESS ? 0 : (w & ~BROKEN_WITNESS) + 1;
+      for (uint32_t i = from; i < mt.count[mask]; i++)
+	{
+	  reached.clear ();
+	  if (all_swaps_in_set (act, lo, hi, mt.get (mask, i), nonc, &reached,
+				&failed[e]))
+	    {
+	      set_witness (e, i);
+	      sort (reached.begin (), reached.end ());
+	      reached.erase (unique (reached.begin (), reached.end ()), reached.end ());
+	      for (size_t k = 0; k < reached.size (); k++)
+		if (reached[k] != c)
+		  {
+		    watch_node nd = {e, i, watch_head[reached[k]]};
+		    set_head (reached[k], nodes.size ());
+		    nodes.push_back (nd);
+		  }
+	      return true;
+	    }
+	}
 
-static void
-canonicalize (precoloring &pc)
-{
-  int mapsto[3] = {-1, -1, -1};
-  int m = 0;
+      set_witness (e, NO_WITNESS);
+      return false;
+    }
 
-  for (precoloring::iterator c = pc.begin (); c != pc.end (); c++)
+  bool check (uint32_t c)
     {
-      if (mapsto[*c] != -1)
-	{
-	  *c = mapsto[*c];
-	  continue;
-	}
-      mapsto[*c] = m;
-      *c = m;
-      m++;
+      return check (c, 0) && check (c, 1) && check (c, 2);
     }
-}
 
-static bool
-all_swaps_in_set (const potent &with, const precoloring &pc, const matching &m, int nonc)
-{
-  int n = m.ps.size ();
-  for (int ss = 0; ss < (1 << n); ss++)
+  void run (void)
     {
-      precoloring spc(pc);
-      swap_on_subset (m, ss, spc, nonc);
-      canonicalize (spc);
-      if (with.count (spc) == 0)
-	return false;
+      for (size_t r = act.next (0); r < act.end (); r = act.next (r + 1))
+	if (!check (r))
+	  queue.push_back (r);
+      propagate ();
     }
 
-  return true;
-}
+  /* Removes X and everything that becomes inconsistent without it.  */
 
-static bool
-is_consistent_in_complcol (const potent &with, const precoloring &pc, int nonc)
-{
-  list<int> positions;
-  int n = pc.size ();
-
-  for (int i = 0; i < n; i++)
-    if (pc[i] != nonc)
-      positions.push_back (i);
-  if (positions.size () <= 2)
-    return true;
-
-  list<matching> ms;
-  gen_matchings (positions, ms);
-  for (list<matching>::iterator m = ms.begin (); m != ms.end (); m++)
-    if (all_swaps_in_set (with, pc, *m, nonc))
-      return true;
-
-  return false;
-}
+  void remove (uint32_t x)
+    {
+      queue.push_back (x);
+      propagate ();
+    }
 
-static bool
-is_consistent (const potent &with, const precoloring &pc)
-{
-  return (is_consistent_in_complcol (with, pc, 0)
-	  && is_consistent_in_complcol (with, pc, 1)
-	  && is_consistent_in_complcol (with, pc, 2));
-}
+  mark save (void) const
+    {
+      mark m = {removed.size (), witness_log.size (), head_log.size (),
+		nodes.size ()};
+      return m;
+    }
 
-static void
-prune_by_consistency (potent &what)
-{
-  bool any;
-  do
+  void restore (const mark &m)
     {
-      any = false;
+      for (; removed.size () > m.removed; removed.pop_back ())
+	act.insert (removed.back ());
+      for (; witness_log.size () > m.witness_log; witness_log.pop_back ())
+	witness[witness_log.back ().first] = witness_log.back ().second;
+      for (; head_log.size () > m.head_log; head_log.pop_back ())
+	watch_head[head_log.back ().first] = head_log.back ().second;
+      nodes.resize (m.nodes);
+    }
 
-      for (potent::const_iterator pc = what.begin (); pc != what.end (); )
+  void propagate (void)
+    {
+      /* The removals are done first and the broken witnesses only
+	 collected, so that the new witnesses are looked for in a set as
+	 small as possible.  */
+      for (;;)
 	{
-	  if (is_consistent (what, *pc))
-	    pc++;
-	  else
+	  while (!queue.empty ())
 	    {
-	      pc = what.erase (pc);
-	      any = true;
+	      uint32_t x = queue.back ();
+	      queue.pop_back ();
+	      if (!act.contains (x))
+		continue;
+
+	      act.erase (x);
+	      if (undoable)
+		removed.push_back (x);
+	      for (uint32_t k = watch_head[x]; k != NO_WITNESS; k = nodes[k].next)
+		{
+		  const watch_node &nd = nodes[k];
+		  if (witness[nd.entry] == nd.witness)
+		    {
+		      set_witness (nd.entry, nd.witness | BROKEN_WITNESS);
+		      broken.push_back (nd.entry);
+		    }
+		}
 	    }
-	}
-    } while (any);
-}
+	  if (broken.empty ())
+	    break;
 
-static string
-chain_name (const precoloring &pc, const matching &m)
-{
-  stringstream rets;
-  int n = m.ps.size ();
-  for (int i = 0; i < n; i++)
-    {
-      int a = m.ps[i].first;
-      int b = m.ps[i].second;
-      rets << a;
-      rets << (pc[a] == pc[b] ? 'o' : 'e');
-      rets << b;
+	  uint32_t e = broken.back ();
+	  broken.pop_back ();
+	  if (act.contains (e / 3) && !check (e / 3, e % 3))
+	    queue.push_back (e / 3);
+	}
     }
-
-  return rets.str ();
-}
+};
 
 struct lpgm
 {
   GRBModel *pgm;
-  map<string,GRBVar> vars;
-
-  lpgm (const potent &with)
+  const coloring_index *idx;
+  const matching_table *mt;
+
+  /* The variables and their keys (see chain_key), by their indices in
+     the model, and the index of each key.  */
+  vector<GRBVar> vars;
+  vector<uint64_t> keys;
+  unordered_map<uint64_t,uint32_t> key_index;
+
+  /* The equations, in the compressed sparse row form: equation C says
+     that the variable ROW_VARS[ROW_START[C]] of a precoloring is the sum
+     of the variables of its chains, ROW_VARS[ROW_START[C] + 1] up to
+     ROW_VARS[ROW_START[C + 1] - 1].  */
+  vector<uint32_t> row_start, row_vars;
+
+  lpgm (const potent &with, const vector<uint32_t> *witness = NULL)
     {
       pgm = new GRBModel (env);
-      gen_equations (with);
-      for (potent::const_iterator pc = with.begin (); pc != with.end (); pc++)
-	get_var (precoloring_name (*pc)).set (GRB_DoubleAttr_LB, 1);
+      gen_equations (with, 1, witness);
       pgm->optimize ();
     }
 
@@ -276,65 +281,141 @@ struct lpgm
       delete pgm;
     }
 
-  GRBVar get_var (string name)
-    {
-      if (vars.count (name) == 0)
-	vars[name] = pgm->addVar (0, GRB_INFINITY, 0, GRB_CONTINUOUS, name);
+  /* Returns the index of the variable with KEY, giving it the next one
+     if it has none yet.  */
 
-      return vars[name];
-    }
-
-  void gen_equations_complcol (const potent &with, const precoloring &pc, int nonc, bool create_vars)
+  uint32_t key_var (uint64_t key)
     {
-      list<int> positions;
-      int n = pc.size ();
+      pair<unordered_map<uint64_t,uint32_t>::iterator,bool> it
+	= key_index.insert (make_pair (key, (uint32_t) keys.size ()));
+      if (it.second)
+	keys.push_back (key);
+      return it.first->second;
+    }
 
-      for (int i = 0; i < n; i++)
-	if (pc[i] != nonc)
-	  positions.push_back (i);
-      if (positions.size () <= 2)
-	return;
+  /* Returns the variable of the precoloring number R, adding it to the
+     model if it has none.  */
 
-      list<matching> ms;
-      gen_matchings (positions, ms);
-      GRBLinExpr cstr;
+  GRBVar coloring_var (size_t r)
+    {
+      uint32_t v = key_var (r);
+      if (v == vars.size ())
+	vars.push_back (pgm->addVar (0, GRB_INFINITY, 0, GRB_CONTINUOUS));
+      return vars[v];
+    }
 
-      stringstream consname;
+  size_t row_end (size_t c) const
+    {
+      return c + 1 < row_start.size () ? row_start[c + 1] : row_vars.size ();
+    }
 
-      string col_name = precoloring_name (pc);
-      GRBVar col_var = get_var (col_name);
-      consname << col_name << " = ";
-      if (!create_vars)
-	cstr += GRBLinExpr (col_var, -1);
+  string row_name (size_t c) const
+    {
+      string name = key_name (keys[row_vars[row_start[c]]], *idx, *mt) + " = ";
       const char *sep = "";
-      for (list<matching>::iterator m = ms.begin (); m != ms.end (); m++)
-	if (all_swaps_in_set (with, pc, *m, nonc))
-	  {
-	    string ch_name = chain_name (pc, *m);
-	    GRBVar ch_var = get_var (ch_name);
-	    consname << sep << ch_name;
-	    if (!create_vars)
-	      cstr += GRBLinExpr (ch_var, 1);
-    	    sep = " + ";
-	  }
-      if (!create_vars)
-	pgm->addConstr (cstr, GRB_EQUAL, 0, consname.str ());
+
+      for (size_t k = row_start[c] + 1; k < row_end (c); k++)
+	{
+	  name += sep + key_name (keys[row_vars[k]], *idx, *mt);
+	  sep = " + ";
+	}
+      return name;
     }
 
-  void gen_equations (const potent &with, const precoloring &pc, bool create_vars)
+  /* Adds the equation of the precoloring number R, packed into LO and HI,
+     and NONC.  If WITNESS is not NULL, it is the witness array of the
+     consistency_pruner that pruned WITH, so the matchings before the
+     witness are known to take R out of WITH and the witness itself is
+     known to keep it in.  */
+
+  void gen_equations_complcol (const potent &with, size_t r, uint32_t lo,
+			       uint32_t hi, int nonc,
+			       const vector<uint32_t> *witness)
     {
-      gen_equations_complcol (with, pc, 0, create_vars);
-      gen_equations_complcol (with, pc, 1, create_vars);
-      gen_equations_complcol (with, pc, 2, create_vars);
+      uint32_t mask = complcol_positions (lo, hi, idx->n, nonc);
+      if (__builtin_popcount (mask) <= 2)
+	return;
+
+      uint32_t from = 0;
+      bool known = false;
+      if (witness)
+	{
+	  uint32_t w = (*witness)[3 * r + nonc];
+	  if (w != NO_WITNESS && !(w & BROKEN_WITNESS))
+	    {
+	      from = w;
+	      known = true;
+	    }
+	}
+
+      row_start.push_back (row_vars.size ());
+      row_vars.push_back (key_var (r));
+      uint16_t failed = 0;
+      for (uint32_t i = from; i < mt->count[mask]; i++)
+	if ((known && i == from)
+	    || all_swaps_in_set (with, lo, hi, mt->get (mask, i), nonc, NULL,
+				 &failed))
+	  row_vars.push_back (key_var (chain_key (lo, hi, mask, i,
+						  mt->get (mask, i))));
     }
 
-  void gen_equations (const potent &with)
+  /* Generates the equations for the precolorings of WITH and adds them to
+     the model in bulk, with the variables of the precolorings of WITH
+     bounded from below by COL_LB.  The names are only generated for the
+     dumps.  WITNESS is as in gen_equations_complcol.  */
+
+  void gen_equations (const potent &with, double col_lb,
+		      const vector<uint32_t> *witness)
     {
-      for (potent::const_iterator pc = with.begin (); pc != with.end (); pc++)
-	gen_equations (with, *pc, true);
+      idx = with.idx;
+      mt = idx ? &ring_matchings (idx->n) : NULL;
+      if (!idx)
+	return;
+
+      for (size_t r = with.next (0); r < with.end (); r = with.next (r + 1))
+	{
+	  uint32_t lo, hi;
+
+	  idx->unrank_packed (r, lo, hi);
+	  for (int nonc = 0; nonc < 3; nonc++)
+	    gen_equations_complcol (with, r, lo, hi, nonc, witness);
+	}
+
+      vector<double> lb;
+      for (size_t r = with.next (0); r < with.end (); r = with.next (r + 1))
+	{
+	  uint32_t v = key_var (r);
+	  if (lb.size () <= v)
+	    lb.resize (keys.size (), 0);
+	  lb[v] = col_lb;
+	}
+      lb.resize (keys.size (), 0);
+
+      GRBVar *vs = pgm->addVars (lb.data (), NULL, NULL, NULL, NULL,
+				 keys.size ());
+      vars.assign (vs, vs + keys.size ());
+      delete[] vs;
       pgm->update ();
-      for (potent::const_iterator pc = with.begin (); pc != with.end (); pc++)
-	gen_equations (with, *pc, false);
+
+      size_t nrows = row_start.size ();
+      vector<GRBLinExpr> exprs (nrows);
+      vector<GRBVar> rvars;
+      vector<double> coeffs;
+      for (size_t c = 0; c < nrows; c++)
+	{
+	  rvars.clear ();
+	  coeffs.clear ();
+	  for (size_t k = row_start[c]; k < row_end (c); k++)
+	    {
+	      rvars.push_back (vars[row_vars[k]]);
+	      coeffs.push_back (k == row_start[c] ? -1 : 1);
+	    }
+	  exprs[c].addTerms (coeffs.data (), rvars.data (), rvars.size ());
+	}
+      vector<char> senses (nrows, GRB_EQUAL);
+      vector<double> rhs (nrows, 0);
+      delete[] pgm->addConstrs (exprs.data (), senses.data (), rhs.data (),
+				NULL, nrows);
     }
 
   void dump_dual (void)
@@ -348,82 +429,150 @@ struct lpgm
 	  if (abs (val) < 1e-6)
 	    continue;
 
-	  printf ("%.3f\t%s\n", val, css[c].get (GRB_StringAttr_ConstrName).c_str ());
+	  printf ("%.3f\t%s\n", val, row_name (c).c_str ());
 	}
 
-      delete css;
+      delete[] css;
     }
 
   void dump (void)
     {
-      GRBConstr *css = pgm->getConstrs ();
-      int n = pgm->get (GRB_IntAttr_NumConstrs);
-
-      for (int c = 0; c < n; c++)
-       	printf ("%s\n", css[c].get (GRB_StringAttr_ConstrName).c_str ());
-
-      delete css;
+      for (size_t c = 0; c < row_start.size (); c++)
+	printf ("%s\n", row_name (c).c_str ());
     }
 };
 
-static void
-test_consistent_sets (const potent &aset, const potent &fix)
-{
-  precoloring act;
-  bool any = false;
+/* Looks for the sets of precolorings that are consistent but not
+   bc-consistent, and dumps them.  Starting from CUR, the search branches
+   on the first precoloring of CUR not in FIX: either it is removed,
+   together with all that becomes inconsistent without it, or it is added
+   to FIX and kept in all sets below.  Branches with more than MAXFIX
+   fixed precolorings are cut.  The sets are bitmaps, and CUR is changed
+   in place and restored by the pruner on the way back, so the memory does
+   not grow with the depth beyond the pruner's undo log.  */
 
-  if (fix.size () > 14)
-    return;
+struct consistent_search
+{
+  potent cur, fix;
+  consistency_pruner pruner;
+  size_t maxfix;
 
-  for (potent::const_iterator pc = aset.begin (); pc != aset.end (); pc++)
-    if (fix.count (*pc) == 0)
-      {
-	act = *pc;
-	any = true;
-	break;
-      }
+  /* The numbers of the visited nodes and of the tested sets, and the
+     times of the start and of the last progress report.  */
+  uint64_t nodes, tested;
+  chrono::steady_clock::time_point start, reported;
 
-  if (!any)
+  consistent_search (const potent &all, size_t mf)
+    : cur (all), pruner (cur, true), maxfix (mf)
     {
-      static int cnt;
+      fix.init (cur.idx->n);
+      nodes = tested = 0;
+      start = reported = chrono::steady_clock::now ();
+    }
+
+  /* Returns the first precoloring of CUR not in FIX, or cur.end ().  */
 
-      cnt++;
-      if (cnt % 1000 == 0)
+  size_t first_free (void) const
+    {
+      for (size_t w = 0; w < cur.bits.size (); w++)
 	{
-	  fprintf (stderr, "#");
-	  fflush (stderr);
+	  uint64_t b = cur.bits[w] & ~fix.bits[w];
+	  if (b)
+	    return w * 64 + __builtin_ctzll (b);
 	}
+      return cur.end ();
+    }
 
-      lpgm *tst = new lpgm (aset);
-      if (!tst->is_bc_consistent ())
-	dump_potent (aset);
-      delete tst;
-      return;
+  void report (const char *what)
+    {
+      chrono::steady_clock::time_point now = chrono::steady_clock::now ();
+      chrono::duration<double> secs = now - start;
+
+      fprintf (stderr,
+	       "# %s: %llu nodes, %llu sets tested, %.1f s, %.0f nodes/s\n",
+	       what, (unsigned long long) nodes, (unsigned long long) tested,
+	       secs.count (), nodes / max (secs.count (), 1e-9));
+      reported = now;
     }
 
+  void search (void)
+    {
+      nodes++;
+      if (nodes % 4096 == 0
+	  && chrono::steady_clock::now () - reported > chrono::seconds (10))
+	report ("progress");
+
+      if (fix.size () > maxfix)
+	return;
 
-  potent naset(aset);
-  naset.erase (act);
-  prune_by_consistency (naset);
-  for (potent::const_iterator pc = fix.begin (); pc != fix.end (); pc++)
-    if (naset.count (*pc) == 0)
-      goto mustbein;
-  test_consistent_sets (naset, fix);
+      size_t act = first_free ();
+      if (act == cur.end ())
+	{
+	  tested++;
+	  lpgm *tst = new lpgm (cur, &pruner.witness);
+	  if (!tst->is_bc_consistent ())
+	    dump_potent (cur);
+	  delete tst;
+	  return;
+	}
 
-mustbein:
-  potent nfix(fix);
-  nfix.insert (act);
-  test_consistent_sets (aset, nfix);
-}
+      consistency_pruner::mark m = pruner.save ();
+      pruner.remove (act);
+      if (fix.subset_of (cur))
+	search ();
+      pruner.restore (m);
 
-int main (void)
+      fix.insert (act);
+      search ();
+      fix.erase (act);
+    }
+
+  void run (void)
+    {
+      pruner.run ();
+      search ();
+      report ("done");
+    }
+};
+
+int main (int argc, char **argv)
 {
+  int opt, ring = 6, maxfix = 14;
+
+  while ((opt = getopt (argc, argv, "f:r:t:")) != -1)
+    switch (opt)
+      {
+      case 'f':
+	maxfix = atoi (optarg);
+	if (maxfix < 0)
+	  {
+	    fprintf (stderr, "Expected -f maxfix, not negative\n");
+	    return 1;
+	  }
+	break;
+      case 'r':
+	ring = atoi (optarg);
+	if (ring < 2 || ring > 20)
+	  {
+	    fprintf (stderr, "Expected -r ring, from 2 to 20\n");
+	    return 1;
+	  }
+	break;
+      case 't':
+	if (!map_ring_tables (optarg))
+	  return 1;
+	break;
+      default:
+	fprintf (stderr, "Usage: %s [-r ring] [-f maxfix] [-t tables]\n", argv[0]);
+	return 1;
+      }
+
   env.set(GRB_IntParam_OutputFlag, 0);
-  potent all, none;
+  potent all;
 
-  gen_all_colorings (6, all);
+  gen_all_colorings (ring, all);
   lpgm(all).dump ();
-  test_consistent_sets (all, none);
+  consistent_search (all, maxfix).run ();
 
   return 0;
 }
@@ -0,0 +1,952 @@
+/* The tables of the rings shared by 4ctconf.cc and consistent.cc: the
+   ring table file, the numbering of the precolorings, the sets of them,
+   the non-crossing matchings, the Kempe swap kernels and the names of the
+   variables of the linear programs.  */
+
+#ifndef RINGS_H
+#define RINGS_H
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <mutex>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+using namespace std;
+
+typedef vector<int> precoloring;
+
+static string
+precoloring_name (const precoloring &col)
+{
+  string ret;
+
+  for (precoloring::const_iterator i = col.begin (); i < col.end (); i++)
+    ret.push_back ('1' + *i);
+
+  return ret;
+}
+
+static void
+dump_precoloring (const precoloring &col)
+{
+  printf ("%s", precoloring_name (col).c_str ());
+}
+
+static bool
+bad_parity (const precoloring &col)
+{
+  int nc[3] = {0, 0, 0};
+  int parity = col.size () % 2;
+
+  for (precoloring::const_iterator i = col.begin (); i < col.end (); i++)
+    nc[*i]++;
+  for (int i = 0; i < 3; i++)
+    if (nc[i] % 2 != parity)
+      return true;
+  return false;
+}
+
+/* The largest ring size supported.  The precolorings of a ring are packed
+   into 32-bit masks, and the tables of larger rings would not fit in
+   memory anyway.  */
+
+#define MAX_RING 20
+
+/* The tables of the rings (the numbering of their precolorings, the
+   precolorings themselves and their matchings) can be precomputed into a
+   ring table file by write_ring_tables and mapped read-only at startup, so
+   that concurrent runs share them.  The file starts with a
+   ring_file_header followed by a ring_file_entry for each ring size.  The
+   arrays are stored in the byte order of the host, at the offsets given
+   by the entries, which are multiples of 8.  RING_FILE_VERSION must be
+   increased whenever the layout or any of the numberings changes.  */
+
+#define RING_FILE_VERSION 1
+
+struct ring_file_header
+{
+  char magic[8];
+  uint32_t version, nrings;
+};
+
+struct ring_file_entry
+{
+  uint32_t n, unused;
+  uint64_t size, npairs;
+
+  /* The offsets of the arrays of coloring_index and matching_table.  */
+  uint64_t counts, below, packed, offset, count, pairs;
+};
+
+static const char ring_file_magic[8] = "4ctring";
+
+/* The mapped ring table file, or NULL.  */
+
+static const char *ring_file;
+static size_t ring_file_size;
+
+/* Returns the entry of the mapped ring table file for rings of OUTER
+   edges, or NULL.  */
+
+static const ring_file_entry *
+mapped_ring (int outer)
+{
+  if (!ring_file)
+    return NULL;
+
+  const ring_file_header *h = (const ring_file_header *) ring_file;
+  const ring_file_entry *e = (const ring_file_entry *) (h + 1);
+  for (uint32_t i = 0; i < h->nrings; i++)
+    if (e[i].n == (uint32_t) outer)
+      return &e[i];
+  return NULL;
+}
+
+static bool
+ring_array_fits (uint64_t off, uint64_t bytes)
+{
+  return (off % 8 == 0 && off <= ring_file_size
+	  && bytes <= ring_file_size - off);
+}
+
+/* Maps the ring table file FNAME.  It stays mapped until the end of the
+   run.  */
+
+static bool
+map_ring_tables (const char *fname)
+{
+  int fd = open (fname, O_RDONLY);
+  struct stat st;
+
+  if (fd < 0 || fstat (fd, &st) < 0)
+    {
+      perror (fname);
+      if (fd >= 0)
+	close (fd);
+      return false;
+    }
+
+  void *map = NULL;
+  if ((size_t) st.st_size >= sizeof (ring_file_header))
+    map = mmap (NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close (fd);
+  if (map == MAP_FAILED)
+    {
+      perror (fname);
+      return false;
+    }
+
+  ring_file = (const char *) map;
+  ring_file_size = st.st_size;
+
+  const ring_file_header *h = (const ring_file_header *) map;
+  bool ok = (map != NULL
+	     && memcmp (h->magic, ring_file_magic, sizeof (h->magic)) == 0
+	     && h->version == RING_FILE_VERSION
+	     && ring_array_fits (sizeof (*h),
+				 (uint64_t) h->nrings * sizeof (ring_file_entry)));
+  for (uint32_t i = 0; ok && i < h->nrings; i++)
+    {
+      const ring_file_entry &e = ((const ring_file_entry *) (h + 1))[i];
+      uint64_t n = e.n;
+      ok = (n >= 1 && n <= 24
+	    && ring_array_fits (e.counts, (n + 1) * 32 * 8)
+	    && ring_array_fits (e.below, n * 32 * 3 * 8)
+	    && ring_array_fits (e.packed, e.size * 8)
+	    && ring_array_fits (e.offset, (1ull << n) * 4)
+	    && ring_array_fits (e.count, (1ull << n) * 4)
+	    && ring_array_fits (e.pairs, e.npairs * 4));
+    }
+  if (!ok)
+    {
+      fprintf (stderr, "%s: not a ring table file of version %d\n", fname,
+	       RING_FILE_VERSION);
+      if (map)
+	munmap (map, st.st_size);
+      ring_file = NULL;
+      ring_file_size = 0;
+    }
+  return ok;
+}
+
+/* Packs the precoloring PC of a ring of at most 32 edges into two bit
+   planes: bit I of LO is the low bit of the color of edge I, bit I of HI
+   the high one.  Swapping the two colors other than NONC on a set of edges
+   is then a xor with its mask, on both planes for NONC 0, on HI for NONC 1
+   and on LO for NONC 2.  */
+
+static void
+pack_coloring (const precoloring &pc, uint32_t &lo, uint32_t &hi)
+{
+  lo = hi = 0;
+  for (size_t i = 0; i < pc.size (); i++)
+    {
+      lo |= (uint32_t) (pc[i] & 1) << i;
+      hi |= (uint32_t) (pc[i] >> 1) << i;
+    }
+}
+
+/* Numbers the canonical precolorings of a ring of N edges with the right
+   parity (those not rejected by bad_parity) densely, in the lexicographic
+   order, so that sets of them can be kept as bitmaps.  */
+
+struct coloring_index
+{
+  int n;
+  size_t size;
+
+  /* COUNTS[(I * 4 + M) * 8 + P] is the number of ways to complete a prefix
+     of length I that uses M colors, with the parities of the numbers of
+     edges of each color given by the bits of P.  */
+  const uint64_t *counts;
+
+  /* BELOW[((I * 4 + M) * 8 + P) * 3 + C] is the number of completions of
+     such a prefix that continue with a color smaller than C.  */
+  const uint64_t *below;
+
+  /* PACKED[R] is the precoloring number R packed as LO | HI << 32 (see
+     pack_coloring) if the index is mapped from a ring table file, NULL
+     otherwise.  */
+  const uint64_t *packed;
+
+  /* The arrays of an index that is not mapped.  */
+  vector<uint64_t> own_counts, own_below;
+
+  coloring_index (int outer)
+    {
+      n = outer;
+      own_counts.assign ((n + 1) * 32, 0);
+      counts = own_counts.data ();
+      packed = NULL;
+      for (int m = 0; m < 4; m++)
+	own_counts[(n * 4 + m) * 8 + (n % 2 ? 7 : 0)] = 1;
+      for (int i = n - 1; i >= 0; i--)
+	for (int m = 0; m < 4; m++)
+	  for (int p = 0; p < 8; p++)
+	    {
+	      uint64_t k = 0;
+	      for (int c = 0; c <= m && c < 3; c++)
+		k += completions (i + 1, max (m, c + 1), p ^ (1 << c));
+	      own_counts[(i * 4 + m) * 8 + p] = k;
+	    }
+      size = completions (0, 0, 0);
+
+      own_below.assign (n * 32 * 3, 0);
+      below = own_below.data ();
+      for (int i = 0; i < n; i++)
+	for (int m = 0; m < 4; m++)
+	  for (int p = 0; p < 8; p++)
+	    for (int c = 1; c < 3; c++)
+	      own_below[((i * 4 + m) * 8 + p) * 3 + c]
+		= (below[((i * 4 + m) * 8 + p) * 3 + c - 1]
+		   + completions (i + 1, max (m, c), p ^ (1 << (c - 1))));
+    }
+
+  coloring_index (const ring_file_entry &e)
+    {
+      n = e.n;
+      size = e.size;
+      counts = (const uint64_t *) (ring_file + e.counts);
+      below = (const uint64_t *) (ring_file + e.below);
+      packed = (const uint64_t *) (ring_file + e.packed);
+    }
+
+  uint64_t completions (int i, int m, int p) const
+    {
+      return counts[(i * 4 + m) * 8 + p];
+    }
+
+  /* Returns the number of the precoloring PC, which must be canonical and
+     have the right parity.  */
+
+  size_t rank (const precoloring &pc) const
+    {
+      size_t r = 0;
+      int m = 0, p = 0;
+
+      for (int i = 0; i < n; i++)
+	{
+	  int col = pc[i];
+	  r += below[((i * 4 + m) * 8 + p) * 3 + col];
+	  m = max (m, col + 1);
+	  p ^= 1 << col;
+	}
+
+      return r;
+    }
+
+  /* The same for the precoloring given by the bit planes LO and HI, see
+     pack_coloring.  */
+
+  size_t rank_packed (uint32_t lo, uint32_t hi) const
+    {
+      size_t r = 0;
+      int m = 0, p = 0;
+
+      for (int i = 0; i < n; i++)
+	{
+	  int col = ((lo >> i) & 1) | (((hi >> i) & 1) << 1);
+	  r += below[((i * 4 + m) * 8 + p) * 3 + col];
+	  m = max (m, col + 1);
+	  p ^= 1 << col;
+	}
+
+      return r;
+    }
+
+  void unrank (size_t r, precoloring &pc) const
+    {
+      int m = 0, p = 0;
+
+      pc.resize (n);
+      for (int i = 0; i < n; i++)
+	{
+	  int c;
+	  for (c = 0; ; c++)
+	    {
+	      uint64_t k = completions (i + 1, max (m, c + 1), p ^ (1 << c));
+	      if (r < k)
+		break;
+	      r -= k;
+	    }
+	  pc[i] = c;
+	  m = max (m, c + 1);
+	  p ^= 1 << c;
+	}
+    }
+
+  /* Stores the precoloring number R packed into LO and HI.  */
+
+  void unrank_packed (size_t r, uint32_t &lo, uint32_t &hi) const
+    {
+      if (packed)
+	{
+	  lo = packed[r];
+	  hi = packed[r] >> 32;
+	  return;
+	}
+
+      precoloring pc;
+      unrank (r, pc);
+      pack_coloring (pc, lo, hi);
+    }
+};
+
+/* Returns the index for rings of OUTER edges, shared by all threads.  */
+
+static const coloring_index &
+ring_index (int outer)
+{
+  static map<int,coloring_index *> indices;
+  static mutex lock;
+  lock_guard<mutex> l (lock);
+
+  coloring_index *&idx = indices[outer];
+  if (!idx)
+    {
+      const ring_file_entry *e = mapped_ring (outer);
+      idx = e ? new coloring_index (*e) : new coloring_index (outer);
+    }
+  return *idx;
+}
+
+/* A set of canonical precolorings of a ring with the right parity, as a
+   bitmap indexed by their numbers in IDX.  A set without IDX is empty; it
+   gets one with the first precoloring inserted, or by init.  The members
+   are visited in the lexicographic order by
+
+     for (size_t r = s.next (0); r < s.end (); r = s.next (r + 1))  */
+
+struct coloring_set
+{
+  const coloring_index *idx;
+  vector<uint64_t> bits;
+  size_t cnt;
+
+  coloring_set (void)
+    {
+      idx = NULL;
+      cnt = 0;
+    }
+
+  void init (int outer)
+    {
+      idx = &ring_index (outer);
+      bits.assign ((idx->size + 63) / 64, 0);
+      cnt = 0;
+    }
+
+  size_t size (void) const
+    {
+      return cnt;
+    }
+
+  bool empty (void) const
+    {
+      return cnt == 0;
+    }
+
+  size_t end (void) const
+    {
+      return idx ? idx->size : 0;
+    }
+
+  /* The bits are read and cleared atomically, so that threads may prune a
+     shared set in place.  */
+
+  bool contains (size_t r) const
+    {
+      uint64_t b = __atomic_load_n (&bits[r / 64], __ATOMIC_RELAXED);
+      return (b >> (r % 64)) & 1;
+    }
+
+  /* Removes R from a set shared with other threads.  The size is not
+     updated until recount is called.  */
+
+  void erase_shared (size_t r)
+    {
+      __atomic_fetch_and (&bits[r / 64], ~(1ull << (r % 64)), __ATOMIC_RELAXED);
+    }
+
+  void recount (void)
+    {
+      cnt = 0;
+      for (size_t w = 0; w < bits.size (); w++)
+	cnt += __builtin_popcountll (bits[w]);
+    }
+
+  bool count (const precoloring &pc) const
+    {
+      return idx && contains (idx->rank (pc));
+    }
+
+  void insert (size_t r)
+    {
+      if (!contains (r))
+	{
+	  bits[r / 64] |= 1ull << (r % 64);
+	  cnt++;
+	}
+    }
+
+  void insert (const precoloring &pc)
+    {
+      if (!idx)
+	init (pc.size ());
+      insert (idx->rank (pc));
+    }
+
+  void erase (size_t r)
+    {
+      if (contains (r))
+	{
+	  bits[r / 64] &= ~(1ull << (r % 64));
+	  cnt--;
+	}
+    }
+
+  /* Returns the smallest member not smaller than R, or end ().  */
+
+  size_t next (size_t r) const
+    {
+      size_t w = r / 64;
+      if (w >= bits.size ())
+	return end ();
+
+      uint64_t b = (__atomic_load_n (&bits[w], __ATOMIC_RELAXED)
+		    & (~0ull << (r % 64)));
+      while (!b)
+	{
+	  if (++w == bits.size ())
+	    return end ();
+	  b = __atomic_load_n (&bits[w], __ATOMIC_RELAXED);
+	}
+      return w * 64 + __builtin_ctzll (b);
+    }
+
+  void get (size_t r, precoloring &pc) const
+    {
+      idx->unrank (r, pc);
+    }
+
+  bool subset_of (const coloring_set &o) const
+    {
+      if (empty ())
+	return true;
+      if (o.idx != idx)
+	return false;
+      for (size_t w = 0; w < bits.size (); w++)
+	if (bits[w] & ~o.bits[w])
+	  return false;
+      return true;
+    }
+
+  /* Removes the members not in O.  */
+
+  void intersect (const coloring_set &o)
+    {
+      if (o.idx != idx)
+	{
+	  bits.assign (bits.size (), 0);
+	  cnt = 0;
+	  return;
+	}
+      cnt = 0;
+      for (size_t w = 0; w < bits.size (); w++)
+	{
+	  bits[w] &= o.bits[w];
+	  cnt += __builtin_popcountll (bits[w]);
+	}
+    }
+};
+
+
+/* A non-crossing perfect matching of some edges of the ring, given by the
+   masks of its N pairs.  */
+
+struct matching
+{
+  const uint32_t *pair;
+  int n;
+};
+
+/* The non-crossing perfect matchings of each set of edges of a ring of N
+   edges.  The matchings of the edges in MASK are the COUNT[MASK]
+   consecutive arrays of popcount (MASK) / 2 pair masks starting at
+   PAIRS[OFFSET[MASK]].  The first pair of each matching contains the
+   lowest edge, and it is followed by the matchings of the edges inside
+   and outside of it, so the pair masks and the order of the matchings are
+   the same as when they are enumerated recursively.  The table has 2^N
+   entries, so it is only built for the rings small enough for the
+   consistency test.  */
+
+struct matching_table
+{
+  int n;
+  size_t npairs;
+  const uint32_t *offset, *count, *pairs;
+
+  /* The arrays of a table that is not mapped from a ring table file.  */
+  vector<uint32_t> own_offset, own_count, own_pairs;
+
+  matching_table (int outer)
+    {
+      vector<uint32_t> &offset = own_offset, &count = own_count;
+      vector<uint32_t> &pairs = own_pairs;
+
+      n = outer;
+      offset.assign (1u << n, 0);
+      count.assign (1u << n, 0);
+      count[0] = 1;
+      for (uint32_t mask = 1; mask < (1u << n); mask++)
+	{
+	  if (__builtin_popcount (mask) % 2)
+	    continue;
+
+	  uint32_t a = mask & -mask, rest = mask ^ a, left = 0;
+	  offset[mask] = pairs.size ();
+	  for (uint32_t r = rest; r; r &= r - 1)
+	    {
+	      uint32_t b = r & -r, right = rest & ~(left | b);
+	      int nl = __builtin_popcount (left) / 2;
+	      int nr = __builtin_popcount (right) / 2;
+	      if (__builtin_popcount (left) % 2 == 0)
+		for (uint32_t i = 0; i < count[left]; i++)
+		  for (uint32_t j = 0; j < count[right]; j++)
+		    {
+		      size_t ml = offset[left] + i * nl;
+		      size_t mr = offset[right] + j * nr;
+		      pairs.push_back (a | b);
+		      for (int k = 0; k < nl; k++)
+			pairs.push_back (uint32_t (pairs[ml + k]));
+		      for (int k = 0; k < nr; k++)
+			pairs.push_back (uint32_t (pairs[mr + k]));
+		      count[mask]++;
+		    }
+	      left |= b;
+	    }
+	}
+
+      npairs = pairs.size ();
+      this->offset = offset.data ();
+      this->count = count.data ();
+      this->pairs = pairs.data ();
+    }
+
+  matching_table (const ring_file_entry &e)
+    {
+      n = e.n;
+      npairs = e.npairs;
+      offset = (const uint32_t *) (ring_file + e.offset);
+      count = (const uint32_t *) (ring_file + e.count);
+      pairs = (const uint32_t *) (ring_file + e.pairs);
+    }
+
+  matching get (uint32_t mask, int i) const
+    {
+      matching m;
+      m.n = __builtin_popcount (mask) / 2;
+      m.pair = pairs + offset[mask] + i * m.n;
+      return m;
+    }
+};
+
+/* Returns the matching table for rings of OUTER edges, shared by all
+   threads.  */
+
+static const matching_table &
+ring_matchings (int outer)
+{
+  static map<int,matching_table *> tables;
+  static mutex lock;
+  lock_guard<mutex> l (lock);
+
+  matching_table *&mt = tables[outer];
+  if (!mt)
+    {
+      const ring_file_entry *e = mapped_ring (outer);
+      mt = e ? new matching_table (*e) : new matching_table (outer);
+    }
+  return *mt;
+}
+
+/* Canonicalizes the packed precoloring LO, HI of the edges in FULL into
+   CLO, CHI: the color of the lowest edge becomes 0 and the color of the
+   lowest edge of a different color becomes 1.  */
+
+static inline void
+canonicalize_packed (uint32_t lo, uint32_t hi, uint32_t full,
+		     uint32_t &clo, uint32_t &chi)
+{
+  uint32_t m0 = full & ~(lo | hi);
+  uint32_t first = (hi & 1) ? hi : (lo & 1) ? lo : m0;
+  uint32_t rest = full & ~first;
+  uint32_t low = rest & -rest;
+  uint32_t second = (hi & low) ? hi : (lo & low) ? lo : m0;
+
+  clo = second & rest;
+  chi = rest & ~second;
+}
+
+/* The numbering of coloring_index for a ring of N edges, computed once
+   at startup and rearranged so that the edges can be ranked two at a
+   time.  The state of a prefix is S = M * 8 + P, with M and P as in
+   coloring_index.  For the edges 2I and 2I + 1 with colors C and D in
+   the state S, K = S * 16 + the key of the two colors (the low bits of C
+   and D followed by their high bits, as they are in the bit planes),
+   ADD[I][K] is what they add to the number and NEXT[K] is the state after
+   them.  LAST[S * 4 + C] is what the last edge of an odd ring adds.  */
+
+template<int N>
+struct ring_tables
+{
+  uint64_t add[N / 2][32 * 16];
+  unsigned char next[32 * 16];
+  uint64_t last[32 * 4];
+
+  ring_tables (void) : add (), next (), last ()
+    {
+      uint64_t counts[N + 1][32] = {}, below[N][32][3] = {};
+
+      for (int m = 0; m < 4; m++)
+	counts[N][m * 8 + (N % 2 ? 7 : 0)] = 1;
+      for (int i = N - 1; i >= 0; i--)
+	for (int s = 0; s < 32; s++)
+	  for (int c = 0; c <= s / 8 && c < 3; c++)
+	    counts[i][s] += counts[i + 1][step (s, c)];
+      for (int i = 0; i < N; i++)
+	for (int s = 0; s < 32; s++)
+	  for (int c = 1; c < 3; c++)
+	    below[i][s][c] = below[i][s][c - 1] + counts[i + 1][step (s, c - 1)];
+
+      for (int i = 0; i < N / 2; i++)
+	for (int s = 0; s < 32; s++)
+	  for (int c = 0; c < 3; c++)
+	    for (int d = 0; d < 3; d++)
+	      {
+		int t = step (s, c);
+		int k = (s * 16 + (c & 1) + ((d & 1) << 1) + ((c >> 1) << 2)
+			 + ((d >> 1) << 3));
+
+		add[i][k] = below[2 * i][s][c] + below[2 * i + 1][t][d];
+		next[k] = step (t, d);
+	      }
+      if (N % 2)
+	for (int s = 0; s < 32; s++)
+	  for (int c = 0; c < 3; c++)
+	    last[s * 4 + c] = below[N - 1][s][c];
+    }
+
+  /* The state after an edge of color C in the state S.  */
+
+  static constexpr int step (int s, int c)
+    {
+      return (s / 8 > c + 1 ? s / 8 : c + 1) * 8 + ((s % 8) ^ (1 << c));
+    }
+};
+
+/* The ring of a set of precolorings as seen by the swap kernels: the mask
+   of its edges and the numbering of the packed precolorings.  FIXED_RING
+   is specialized for a ring size, so that the tables are constant and the
+   loop over the edges has a constant length; RUNTIME_RING serves the
+   other sizes.  */
+
+template<int N>
+struct fixed_ring
+{
+  static constexpr uint32_t full = (1u << N) - 1;
+  static const ring_tables<N> tab;
+
+  size_t rank_packed (uint32_t lo, uint32_t hi) const
+    {
+      size_t r = 0;
+      unsigned s = 0;
+
+      for (int i = 0; i < N / 2; i++)
+	{
+	  unsigned k = (s * 16 + ((lo >> (2 * i)) & 3)
+			+ (((hi >> (2 * i)) & 3) << 2));
+	  r += tab.add[i][k];
+	  s = tab.next[k];
+	}
+      if (N % 2)
+	r += tab.last[s * 4 + ((lo >> (N - 1)) & 1)
+		      + (((hi >> (N - 1)) & 1) << 1)];
+
+      return r;
+    }
+};
+
+template<int N> constexpr uint32_t fixed_ring<N>::full;
+template<int N> const ring_tables<N> fixed_ring<N>::tab;
+
+struct runtime_ring
+{
+  const coloring_index &idx;
+  uint32_t full;
+
+  runtime_ring (const coloring_index &i)
+    : idx (i), full (i.n == 32 ? ~0u : (1u << i.n) - 1)
+    {
+    }
+
+  size_t rank_packed (uint32_t lo, uint32_t hi) const
+    {
+      return idx.rank_packed (lo, hi);
+    }
+};
+
+/* Returns true if the packed precoloring LO, HI of RING, with the bits in
+   FLO and FHI of the edges in X flipped, is in WITH.  Its number is stored
+   to R.  */
+
+template<class ring>
+static inline bool
+swap_in_set (const coloring_set &with, const ring &rg, uint32_t lo,
+	     uint32_t hi, uint32_t x, uint32_t flo, uint32_t fhi, size_t &r)
+{
+  uint32_t clo, chi;
+
+  canonicalize_packed (lo ^ (x & flo), hi ^ (x & fhi), rg.full, clo, chi);
+  r = rg.rank_packed (clo, chi);
+  return with.contains (r);
+}
+
+/* Returns true if all precolorings obtained from the precoloring packed
+   into LO and HI, which is in WITH, by swapping the colors other than NONC
+   on a subset of the pairs of M are in WITH.  If REACHED is not NULL,
+   their numbers are appended to it.  If FAILED is not NULL, the subset it
+   points to (as a mask of pairs) is tried first, since a subset that took
+   a precoloring out of the set for one matching often does so for the
+   next one as well, and the failing subset is stored in it.
+
+   Most calls fail, and the swaps on one or two pairs are the ones that
+   fail most often (over 80% of the failures when pruning blockcntredu and
+   random sets of ring 12), so these are tried next.  The rest are walked
+   in the Gray code order, changing one pair in each step.  Swapping on
+   all pairs only exchanges two colors, so a subset and its complement
+   give the same canonical precoloring and the subsets without the last
+   pair are enough.  */
+
+template<class ring>
+static bool
+all_swaps_in_ring (const coloring_set &with, const ring &rg, uint32_t lo,
+		   uint32_t hi, const matching &m, int nonc, vector<uint32_t> *reached,
+		   uint16_t *failed)
+{
+  int n = m.n;
+  const uint32_t *pair = m.pair;
+  uint32_t flo = nonc != 1 ? ~0u : 0, fhi = nonc != 2 ? ~0u : 0;
+  uint32_t x;
+  size_t r;
+
+  if (failed && *failed && (*failed >> n) == 0)
+    {
+      x = 0;
+      for (int i = 0; i < n; i++)
+	if ((*failed >> i) & 1)
+	  x |= pair[i];
+      if (!swap_in_set (with, rg, lo, hi, x, flo, fhi, r))
+	return false;
+    }
+
+  for (int i = 0; i < n; i++)
+    for (int j = i; j < n; j++)
+      if (!swap_in_set (with, rg, lo, hi, pair[i] | pair[j], flo, fhi, r))
+	{
+	  if (failed)
+	    *failed = (1u << i) | (1u << j);
+	  return false;
+	}
+
+  x = 0;
+  for (uint32_t k = 1; k < (1u << (n - 1)); k++)
+    {
+      uint32_t g = k ^ (k >> 1);
+      int size = __builtin_popcount (g);
+
+      x ^= pair[__builtin_ctz (k)];
+      if (size <= 2 || n - size <= 2)
+	{
+	  /* Tested above.  */
+	  if (reached)
+	    {
+	      swap_in_set (with, rg, lo, hi, x, flo, fhi, r);
+	      reached->push_back (r);
+	    }
+	  continue;
+	}
+
+      if (!swap_in_set (with, rg, lo, hi, x, flo, fhi, r))
+	{
+	  if (failed)
+	    *failed = g;
+	  return false;
+	}
+      if (reached)
+	reached->push_back (r);
+    }
+
+  return true;
+}
+
+template<int N>
+static bool
+all_swaps_fixed (const coloring_set &with, uint32_t lo, uint32_t hi,
+		 const matching &m, int nonc, vector<uint32_t> *reached,
+		 uint16_t *failed)
+{
+  return all_swaps_in_ring (with, fixed_ring<N> (), lo, hi, m, nonc,
+			    reached, failed);
+}
+
+typedef bool (*swaps_kernel) (const coloring_set &, uint32_t, uint32_t,
+			      const matching &, int, vector<uint32_t> *,
+			      uint16_t *);
+
+/* The kernels specialized for the ring sizes 4 to 16, by the size.  */
+
+static const swaps_kernel fixed_kernels[17] =
+{
+  NULL, NULL, NULL, NULL,
+  all_swaps_fixed<4>, all_swaps_fixed<5>, all_swaps_fixed<6>,
+  all_swaps_fixed<7>, all_swaps_fixed<8>, all_swaps_fixed<9>,
+  all_swaps_fixed<10>, all_swaps_fixed<11>, all_swaps_fixed<12>,
+  all_swaps_fixed<13>, all_swaps_fixed<14>, all_swaps_fixed<15>,
+  all_swaps_fixed<16>
+};
+
+static bool
+all_swaps_in_set (const coloring_set &with, uint32_t lo, uint32_t hi,
+		  const matching &m, int nonc, vector<uint32_t> *reached,
+		  uint16_t *failed)
+{
+  int n = with.idx->n;
+
+  if (n <= 16 && fixed_kernels[n])
+    return fixed_kernels[n] (with, lo, hi, m, nonc, reached, failed);
+  return all_swaps_in_ring (with, runtime_ring (*with.idx), lo, hi, m, nonc,
+			    reached, failed);
+}
+
+/* Returns the mask of the edges of the packed precoloring LO, HI of a ring
+   of LEN edges that do not have color NONC.  */
+
+static uint32_t
+complcol_positions (uint32_t lo, uint32_t hi, int len, int nonc)
+{
+  uint32_t full = len == 32 ? ~0u : (1u << len) - 1;
+
+  return full & ~(nonc == 0 ? ~(lo | hi) : nonc == 1 ? lo : hi);
+}
+
+#define NO_WITNESS 0xffffffffu
+#define BROKEN_WITNESS 0x80000000u
+
+/* The variables of the linear program are keyed by 64-bit codes.  The
+   variable of a precoloring has its number in the coloring_index as the
+   key.  A Kempe chain is the matching I of the edges in MASK (see
+   matching_table) together with a bit for each pair, set if its edges
+   have the same color.  Its key is MASK << 32 | I << 16 | SAME, which
+   never collides with a precoloring, since a matching has at least two
+   pairs; this needs fewer than 2^16 matchings per mask and at most 16
+   pairs, which holds for rings of up to 23 edges.  */
+
+static inline uint64_t
+chain_key (uint32_t lo, uint32_t hi, uint32_t mask, uint32_t i,
+	   const matching &m)
+{
+  uint32_t same = 0;
+
+  for (int k = 0; k < m.n; k++)
+    {
+      int a = __builtin_ctz (m.pair[k]);
+      int b = 31 - __builtin_clz (m.pair[k]);
+      if (((lo >> a) & 1) == ((lo >> b) & 1)
+	  && ((hi >> a) & 1) == ((hi >> b) & 1))
+	same |= 1u << k;
+    }
+
+  return (uint64_t) mask << 32 | (uint64_t) i << 16 | same;
+}
+
+static string
+chain_name (const matching &m, uint32_t same)
+{
+  stringstream rets;
+  int n = m.n;
+  for (int i = 0; i < n; i++)
+    {
+      int a = __builtin_ctz (m.pair[i]);
+      int b = 31 - __builtin_clz (m.pair[i]);
+      rets << a;
+      rets << ((same >> i) & 1 ? 'o' : 'e');
+      rets << b;
+    }
+
+  return rets.str ();
+}
+
+/* The name of the variable with KEY, for the ring of IDX and MT.  */
+
+static string
+key_name (uint64_t key, const coloring_index &idx, const matching_table &mt)
+{
+  if ((key >> 32) == 0)
+    {
+      precoloring pc;
+      idx.unrank (key, pc);
+      return precoloring_name (pc);
+    }
+
+  return chain_name (mt.get (key >> 32, (key >> 16) & 0xffff), key & 0xffff);
+}
+
+#endif